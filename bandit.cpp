@@ -0,0 +1,43 @@
+/*
+ * bandit.cpp
+ *
+ *  UCB ordering of flip queries, learned over all epochs.
+ */
+#include "bandit.h"
+#include <algorithm>
+#include <math.h>
+
+double FlipBandit::score(const z3::expr & term) const{
+	auto it = arms.find((Z3_ast)term);
+	if (it == arms.end() || it->second.pulls == 0){
+		return INFINITY;
+	}
+	const Arm & arm = it->second;
+	double rate = samples / std::max(seconds, 1e-9);
+	double mean = arm.samples / std::max(arm.seconds, 1e-9) / std::max(rate, 1e-9);
+	return mean + exploration * sqrt(log((double)pulls) / arm.pulls);
+}
+
+std::vector<int> FlipBandit::order(const std::vector<z3::expr> & terms) const{
+	std::vector<int> order(terms.size());
+	std::vector<double> scores(terms.size());
+	for (size_t i = 0; i < terms.size(); i++){
+		order[i] = i;
+		scores[i] = score(terms[i]);
+	}
+	std::stable_sort(order.begin(), order.end(), [&scores](int a, int b){ return scores[a] > scores[b]; });
+	return order;
+}
+
+void FlipBandit::record(const z3::expr & term, double new_samples, double query_seconds){
+	auto it = arms.find((Z3_ast)term);
+	if (it == arms.end()){
+		it = arms.emplace((Z3_ast)term, Arm(term)).first;
+	}
+	it->second.samples += new_samples;
+	it->second.seconds += query_seconds;
+	++it->second.pulls;
+	++pulls;
+	samples += new_samples;
+	seconds += query_seconds;
+}
@@ -0,0 +1,56 @@
+/*
+ * bandit.h
+ *
+ *  UCB ordering of flip queries, learned over all epochs.
+ */
+
+#ifndef BANDIT_H_
+#define BANDIT_H_
+
+#include <z3++.h>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Learns how many new unique samples flipping each term yields per solver second, and orders flip queries
+ * by a UCB score of that yield. A term is what a flip query changes: a bit of a variable, of an array entry
+ * or of a function application. Terms are told apart by their AST, so each keeps its statistics across epochs.
+ */
+class FlipBandit{
+
+	struct Arm{
+		z3::expr term; // keeps the AST, and so the key, alive
+		double samples = 0.0; // new unique samples
+		double seconds = 0.0; // solver time
+		int pulls = 0;
+		explicit Arm(const z3::expr & term) : term(term) {}
+	};
+
+	std::unordered_map<Z3_ast, Arm> arms;
+	double exploration;
+	int pulls = 0;
+	double samples = 0.0;
+	double seconds = 0.0;
+
+public:
+	explicit FlipBandit(double exploration = 1.4) : exploration(exploration) {}
+	/*
+	 * UCB score of flipping term: its new unique samples per solver second, relative to the rate of all flips,
+	 * plus an exploration bonus. Terms never flipped come first.
+	 */
+	double score(const z3::expr & term) const;
+	/*
+	 * Returns the indices of terms by decreasing score (terms with equal scores keep their order).
+	 */
+	std::vector<int> order(const std::vector<z3::expr> & terms) const;
+	/*
+	 * Records a flip query of term that found new_samples new unique samples in the given solver time.
+	 */
+	void record(const z3::expr & term, double new_samples, double query_seconds);
+	/*
+	 * Returns the number of terms with statistics.
+	 */
+	size_t size() const { return arms.size(); }
+};
+
+#endif /* BANDIT_H_ */
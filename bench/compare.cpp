@@ -0,0 +1,241 @@
+/*
+ * compare.cpp
+ *
+ *  Head-to-head regression check of the Sampler/MEGASampler pipeline against the original sampler.
+ *
+ *  usage: compare [-s sampler] [-r reference] [-t seconds] [-tol fraction] [formula.smt2 ...]
+ *
+ *  Both engines run with --smtbit and the same time budget on every formula (by default the
+ *  examples and a few generated QF_BV and QF_ABV formulas). Unique samples, samples per second,
+ *  coverage and time to first sample are compared; the exit code is 1 if the new pipeline is
+ *  worse than the reference by more than the tolerance (default 0.1) on any of them.
+ *  Time to first sample is measured here, as the time from starting the process to the line
+ *  announcing the first sample, so that both engines are timed the same way.
+ */
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct EngineResult{
+	double total_time = 0.0;
+	double first_sample_time = -1.0; // -1 if no sample was produced
+	long unique = 0;
+	long coverage = 0; // covered node values (Bool and bit-vector)
+	double rate() const { return total_time > 0 ? unique / total_time : 0.0; }
+};
+
+static double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1.0e-9 * t.tv_nsec;
+}
+
+/*
+ * Runs args, reading its output line by line. first_sample tells whether a line announces the first sample;
+ * the time at which that line arrived is stored in the result. The process is killed after timeout seconds.
+ */
+static std::string run_engine(const std::vector<std::string> & args, double timeout, bool (*first_sample)(const std::string &), double & first_sample_time){
+	int fds[2];
+	if (pipe(fds) < 0){
+		perror("pipe");
+		exit(1);
+	}
+	double start = now();
+	pid_t pid = fork();
+	if (pid == 0){
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		std::vector<char *> argv;
+		for (const std::string & a : args){
+			argv.push_back(const_cast<char *>(a.c_str()));
+		}
+		argv.push_back(NULL);
+		execv(argv[0], argv.data());
+		perror(argv[0]);
+		_exit(127);
+	}
+	close(fds[1]);
+	std::string output;
+	std::string line;
+	first_sample_time = -1.0;
+	bool killed = false;
+	while (true){
+		double left = start + timeout - now();
+		if (left <= 0 && !killed){
+			std::cerr << args[0] << " did not stop in time, killing it\n";
+			kill(pid, SIGKILL);
+			killed = true;
+		}
+		struct pollfd pfd = { fds[0], POLLIN, 0 };
+		if (poll(&pfd, 1, killed ? 1000 : (int)(left * 1000) + 1) <= 0){
+			continue;
+		}
+		char buffer[65536];
+		ssize_t n = read(fds[0], buffer, sizeof(buffer));
+		if (n <= 0){
+			break;
+		}
+		for (ssize_t i = 0; i < n; i++){
+			if (buffer[i] != '\n'){
+				line += buffer[i];
+				continue;
+			}
+			if (first_sample_time < 0 && first_sample(line)){
+				first_sample_time = now() - start;
+			}
+			output += line + '\n';
+			line.clear();
+		}
+	}
+	close(fds[0]);
+	int status;
+	waitpid(pid, &status, 0);
+	return output;
+}
+
+/*
+ * Returns the text following prefix on the last line of output that starts with it ("" if none).
+ */
+static std::string last_value(const std::string & output, const std::string & prefix){
+	std::string value;
+	std::istringstream lines(output);
+	std::string line;
+	while (std::getline(lines, line)){
+		if (line.compare(0, prefix.size(), prefix) == 0){
+			value = line.substr(prefix.size());
+		}
+	}
+	return value;
+}
+
+/*
+ * Parses "a/b, coverage bv c/d" into a + c.
+ */
+static long parse_coverage(const std::string & text){
+	long covered_bool = 0, all_bool = 0, covered_bv = 0, all_bv = 0;
+	if (sscanf(text.c_str(), "%ld/%ld, coverage bv %ld/%ld", &covered_bool, &all_bool, &covered_bv, &all_bv) != 4){
+		return 0;
+	}
+	return covered_bool + covered_bv;
+}
+
+static bool new_first_sample(const std::string & line){
+	return line.compare(0, 19, "First sample time: ") == 0;
+}
+
+static bool reference_first_sample(const std::string & line){
+	// the original sampler prints its statistics (with a flush) right after outputting its first model
+	return line.compare(0, 14, "Valid samples ") == 0 && atol(line.c_str() + 14) > 0;
+}
+
+static EngineResult run_new(const std::string & sampler, const std::string & formula, double budget){
+	EngineResult r;
+	std::string out = run_engine({sampler, "-t", std::to_string(budget), "--seed", "1", "--smtbit", "--coverage", formula}, 2 * budget + 10.0, new_first_sample, r.first_sample_time);
+	r.total_time = atof(last_value(out, "total time: ").c_str());
+	r.unique = atol(last_value(out, "Unique models (# samples in file): ").c_str());
+	r.coverage = parse_coverage(last_value(out, "Coverage bool: "));
+	return r;
+}
+
+static EngineResult run_reference(const std::string & reference, const std::string & formula, double budget){
+	EngineResult r;
+	std::string out = run_engine({reference, "-t", std::to_string(budget), "--smtbit", formula}, 2 * budget + 10.0, reference_first_sample, r.first_sample_time);
+	r.total_time = atof(last_value(out, "Total time ").c_str());
+	r.unique = atol(last_value(out, "Unique valid samples ").c_str());
+	r.coverage = parse_coverage(last_value(out, "Coverage bool: "));
+	return r;
+}
+
+static std::vector<std::string> default_formulas(){
+	std::vector<std::string> formulas;
+	mkdir("formulas", 0755);
+	// copies of the examples, since both engines write their .samples file next to the formula
+	for (const char * example : {"f_bv", "one_solution"}){
+		std::ifstream in(std::string("../examples/") + example + ".smt2");
+		std::string path = std::string("formulas/compare_") + example + ".smt2";
+		std::ofstream out(path);
+		out << in.rdbuf();
+		formulas.push_back(path);
+	}
+	const char * generated[][6] = {{"QF_BV", "8", "32", "2", "1", "1"}, {"QF_BV", "16", "64", "2", "0.5", "3"}, {"QF_ABV", "8", "32", "2", "1", "8"}};
+	for (auto & g : generated){
+		std::string path = std::string("formulas/compare_") + g[0] + "_s" + g[5] + ".smt2";
+		std::string command = std::string("./generate");
+		for (int i = 0; i < 6; i++){
+			command += std::string(" ") + g[i];
+		}
+		if (system((command + " > " + path).c_str()) != 0){
+			std::cerr << "Could not generate " << path << " (build bench/generate first)\n";
+			continue;
+		}
+		formulas.push_back(path);
+	}
+	return formulas;
+}
+
+int main(int argc, char * argv[]){
+	std::string sampler = "../smtsampler";
+	std::string reference = "../smtsamplerorig";
+	double budget = 30.0;
+	double tolerance = 0.1;
+	std::vector<std::string> formulas;
+	for (int i = 1; i < argc; ++i){
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			sampler = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			reference = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			budget = atof(argv[++i]);
+		else if (strcmp(argv[i], "-tol") == 0 && i + 1 < argc)
+			tolerance = atof(argv[++i]);
+		else
+			formulas.push_back(argv[i]);
+	}
+	if (formulas.empty()){
+		formulas = default_formulas();
+	}
+
+	int regressions = 0;
+	std::cout << std::fixed << std::setprecision(3);
+	for (const std::string & formula : formulas){
+		EngineResult ref = run_reference(reference, formula, budget);
+		EngineResult cur = run_new(sampler, formula, budget);
+		std::cout << formula << '\n';
+		std::cout << "  unique samples:       " << cur.unique << " vs " << ref.unique << '\n';
+		std::cout << "  samples/sec:          " << cur.rate() << " vs " << ref.rate() << '\n';
+		std::cout << "  coverage:             " << cur.coverage << " vs " << ref.coverage << '\n';
+		std::cout << "  time to first sample: " << cur.first_sample_time << " vs " << ref.first_sample_time << '\n';
+		std::vector<std::string> worse;
+		if (cur.unique < (1.0 - tolerance) * ref.unique)
+			worse.push_back("unique samples");
+		if (cur.rate() < (1.0 - tolerance) * ref.rate())
+			worse.push_back("samples/sec");
+		if (cur.coverage < (1.0 - tolerance) * ref.coverage)
+			worse.push_back("coverage");
+		if (ref.first_sample_time >= 0 && (cur.first_sample_time < 0 || cur.first_sample_time > (1.0 + tolerance) * ref.first_sample_time + 0.05))
+			worse.push_back("time to first sample");
+		for (const std::string & w : worse){
+			std::cout << "  REGRESSION: " << w << '\n';
+		}
+		regressions += worse.size();
+	}
+	if (regressions){
+		std::cout << regressions << " regressions beyond tolerance " << tolerance << '\n';
+	} else {
+		std::cout << "No regressions beyond tolerance " << tolerance << '\n';
+	}
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * generate.cpp
+ *
+ *  Generator of random satisfiable QF_BV, QF_LIA and QF_ABV formulas for benchmarking.
+ *
+ *  usage: generate <QF_BV|QF_LIA|QF_ABV> <variables> <width> <depth> <density> <seed>
+ *
+ *  A random assignment is planted first; every generated constraint is evaluated under it
+ *  and negated if false, so the formula is always satisfiable. The output depends only on
+ *  the arguments (the generator does not use rand()), so suites are reproducible.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+enum Logic {LOGIC_BV, LOGIC_LIA, LOGIC_ABV};
+
+struct Term{
+	std::string text;
+	int64_t value; // value under the planted assignment (bit-vectors: masked to width)
+};
+
+class Generator{
+
+	Logic logic;
+	int num_vars;
+	int width;
+	int depth;
+	std::mt19937_64 rng;
+	uint64_t mask;
+	std::vector<int64_t> planted;
+	std::vector<std::map<uint64_t, uint64_t>> planted_arrays; // unlisted indices hold 0
+	int num_arrays;
+
+public:
+	Generator(Logic logic, int num_vars, int width, int depth, uint64_t seed) : logic(logic), num_vars(num_vars), width(width), depth(depth), rng(seed){
+		mask = width >= 64 ? ~0ull : (1ull << width) - 1;
+		num_arrays = logic == LOGIC_ABV ? (num_vars + 3) / 4 : 0;
+		for (int i = 0; i < num_vars; i++){
+			planted.push_back(random_value());
+		}
+		for (int a = 0; a < num_arrays; a++){
+			std::map<uint64_t, uint64_t> contents;
+			for (int k = 0; k < 4; k++){
+				contents[random_value()] = random_value();
+			}
+			planted_arrays.push_back(contents);
+		}
+	}
+
+	void print(std::ostream & out, int num_constraints){
+		out << "(set-logic " << (logic == LOGIC_BV ? "QF_BV" : logic == LOGIC_LIA ? "QF_LIA" : "QF_ABV") << ")\n";
+		for (int i = 0; i < num_vars; i++){
+			out << "(declare-const x" << i << ' ' << sort() << ")\n";
+		}
+		for (int a = 0; a < num_arrays; a++){
+			out << "(declare-const a" << a << " (Array " << sort() << ' ' << sort() << "))\n";
+		}
+		if (logic == LOGIC_LIA){
+			for (int i = 0; i < num_vars; i++){
+				out << "(assert (and (<= 0 x" << i << ") (<= x" << i << ' ' << (int64_t)mask << ")))\n";
+			}
+		}
+		for (int k = 0; k < num_constraints; k++){
+			out << "(assert " << constraint().text << ")\n";
+		}
+		out << "(check-sat)\n(exit)\n";
+	}
+
+protected:
+	int64_t random_value(){
+		return rng() & mask;
+	}
+
+	int pick(int n){
+		return rng() % n;
+	}
+
+	std::string sort(){
+		return logic == LOGIC_LIA ? "Int" : "(_ BitVec " + std::to_string(width) + ")";
+	}
+
+	std::string numeral(int64_t v){
+		if (logic == LOGIC_LIA){
+			return v < 0 ? "(- " + std::to_string(-v) + ")" : std::to_string(v);
+		}
+		return "(_ bv" + std::to_string((uint64_t)v & mask) + ' ' + std::to_string(width) + ')';
+	}
+
+	Term leaf(){
+		if (num_arrays > 0 && pick(3) == 0){
+			int a = pick(num_arrays);
+			Term index = term(0);
+			auto it = planted_arrays[a].find(index.value);
+			return {"(select a" + std::to_string(a) + ' ' + index.text + ')', it == planted_arrays[a].end() ? 0 : (int64_t)it->second};
+		}
+		if (pick(4) == 0){
+			int64_t v = random_value();
+			return {numeral(v), v};
+		}
+		int i = pick(num_vars);
+		return {"x" + std::to_string(i), planted[i]};
+	}
+
+	Term term(int d){
+		if (d == 0){
+			return leaf();
+		}
+		if (logic == LOGIC_LIA){
+			return lia_term(d);
+		}
+		return bv_term(d);
+	}
+
+	Term lia_term(int d){
+		Term a = term(d - 1);
+		switch (pick(3)){
+			case 0:
+			{
+				Term b = term(d - 1);
+				return {"(+ " + a.text + ' ' + b.text + ')', a.value + b.value};
+			}
+			case 1:
+			{
+				Term b = term(d - 1);
+				return {"(- " + a.text + ' ' + b.text + ')', a.value - b.value};
+			}
+			default:
+			{
+				int64_t k = pick(7) - 3;
+				return {"(* " + numeral(k) + ' ' + a.text + ')', k * a.value};
+			}
+		}
+	}
+
+	Term bv_term(int d){
+		static const char * ops[] = {"bvadd", "bvsub", "bvmul", "bvand", "bvor", "bvxor", "bvnot", "bvshl", "bvlshr"};
+		int op = pick(9);
+		Term a = term(d - 1);
+		if (op == 6){
+			return {"(bvnot " + a.text + ')', (int64_t)(~(uint64_t)a.value & mask)};
+		}
+		Term b = term(d - 1);
+		uint64_t x = a.value, y = b.value, r = 0;
+		switch (op){
+			case 0: r = x + y; break;
+			case 1: r = x - y; break;
+			case 2: r = x * y; break;
+			case 3: r = x & y; break;
+			case 4: r = x | y; break;
+			case 5: r = x ^ y; break;
+			case 7: r = y >= (uint64_t)width ? 0 : x << y; break;
+			case 8: r = y >= (uint64_t)width ? 0 : x >> y; break;
+		}
+		Term t = {std::string("(") + ops[op] + ' ' + a.text + ' ' + b.text + ')', (int64_t)(r & mask)};
+		if (num_arrays > 0 && pick(4) == 0){
+			// read back through a store, so that array terms nest
+			int arr = pick(num_arrays);
+			Term i = leaf();
+			Term j = leaf();
+			auto it = planted_arrays[arr].find(j.value);
+			int64_t v = i.value == j.value ? t.value : it == planted_arrays[arr].end() ? 0 : (int64_t)it->second;
+			return {"(select (store a" + std::to_string(arr) + ' ' + i.text + ' ' + t.text + ") " + j.text + ')', v};
+		}
+		return t;
+	}
+
+	Term constraint(){
+		Term a = term(depth);
+		Term b = term(pick(depth + 1));
+		bool holds;
+		std::string op;
+		if (logic == LOGIC_LIA){
+			switch (pick(3)){
+				case 0: op = "<="; holds = a.value <= b.value; break;
+				case 1: op = "<"; holds = a.value < b.value; break;
+				default: op = "="; holds = a.value == b.value; break;
+			}
+		} else {
+			switch (pick(3)){
+				case 0: op = "bvule"; holds = (uint64_t)a.value <= (uint64_t)b.value; break;
+				case 1: op = "bvult"; holds = (uint64_t)a.value < (uint64_t)b.value; break;
+				default: op = "="; holds = a.value == b.value; break;
+			}
+		}
+		std::string text = '(' + op + ' ' + a.text + ' ' + b.text + ')';
+		return {holds ? text : "(not " + text + ')', 1};
+	}
+};
+
+int main(int argc, char * argv[]){
+	if (argc != 7){
+		std::cerr << "usage: generate <QF_BV|QF_LIA|QF_ABV> <variables> <width> <depth> <density> <seed>\n";
+		return 1;
+	}
+	Logic logic;
+	if (strcmp(argv[1], "QF_BV") == 0){
+		logic = LOGIC_BV;
+	} else if (strcmp(argv[1], "QF_LIA") == 0){
+		logic = LOGIC_LIA;
+	} else if (strcmp(argv[1], "QF_ABV") == 0){
+		logic = LOGIC_ABV;
+	} else {
+		std::cerr << "Unknown logic " << argv[1] << '\n';
+		return 1;
+	}
+	int num_vars = atoi(argv[2]);
+	int width = atoi(argv[3]);
+	int depth = atoi(argv[4]);
+	double density = atof(argv[5]); // constraints per variable
+	uint64_t seed = strtoull(argv[6], NULL, 10);
+	if (num_vars < 1 || width < 1 || width > 64 || depth < 0){
+		std::cerr << "Need at least one variable, width between 1 and 64 and depth >= 0\n";
+		return 1;
+	}
+	if (logic == LOGIC_LIA && width > 20){
+		width = 20; // keeps planted values and linear combinations far from overflow
+	}
+	Generator g(logic, num_vars, width, depth, seed);
+	int num_constraints = (int)(density * num_vars + 0.5);
+	g.print(std::cout, num_constraints < 1 ? 1 : num_constraints);
+	return 0;
+}
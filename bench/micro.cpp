@@ -0,0 +1,305 @@
+/*
+ * micro.cpp
+ *
+ *  Microbenchmarks of the serialization, combination and validation hot paths.
+ *
+ *  usage: micro [-m milliseconds per benchmark]
+ *
+ *  Fixtures are the formulas in examples/ plus a wide bit-vector formula and an array-heavy one,
+ *  generated here. SMTSampler exits on Int and Real variables, so formulas with them (f_lia) only get
+ *  the Sampler benchmarks. Every benchmark reports ns/op and allocs/op, where allocations are the calls
+ *  to operator new (Z3 allocates its own objects with malloc, so those are not counted).
+ *  The flip phase of SMTSampler is run for a few epochs per fixture with single-bit and with batched
+ *  queries, on the examples and on a formula whose bits are mostly fixed, and reports for each epoch
+ *  its time, solver calls, flips, the bits found to be fixed and the flips the ordering has statistics of.
+ */
+#include "../smtsampler.cpp"
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <algorithm>
+#include <new>
+#include <sstream>
+
+static std::atomic<uint64_t> allocations(0);
+
+void * operator new(size_t size){
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void * p = malloc(size ? size : 1);
+	if (!p){
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void * p) noexcept{
+	free(p);
+}
+
+static double min_time_ms = 200.0;
+static const int FLIP_EPOCHS = 3; // epochs of the flip phase, so that its ordering is learned and used
+static volatile size_t sink; // keeps results alive, so that benchmarked calls are not optimized away
+
+/*
+ * Runs f in growing batches until min_time_ms has passed and prints ns/op and allocs/op.
+ */
+template<typename F>
+static void bench(const std::string & fixture, const std::string & name, F f){
+	f(); // warm up
+	uint64_t ops = 0;
+	uint64_t batch = 1;
+	uint64_t allocs_before = allocations.load();
+	uint64_t start = monotonic_ns();
+	uint64_t elapsed = 0;
+	while (elapsed < min_time_ms * 1.0e6){
+		for (uint64_t i = 0; i < batch; i++){
+			f();
+		}
+		ops += batch;
+		batch *= 2;
+		elapsed = monotonic_ns() - start;
+	}
+	double allocs = (double)(allocations.load() - allocs_before) / ops;
+	printf("%-22s %-32s %14.1f ns/op %10.1f allocs/op\n", fixture.c_str(), name.c_str(), (double)elapsed / ops, allocs);
+	fflush(stdout);
+}
+
+/*
+ * Exposes the protected serialization of Sampler.
+ */
+class BenchSampler : public Sampler{
+public:
+	BenchSampler(std::string input) : Sampler(input, 1000000, 3600.0, 10000, 600.0, STRAT_SMTBIT) {}
+	z3::model solve_once(){
+		z3::solver s(c);
+		s.add(original_formula);
+		s.check();
+		return s.get_model();
+	}
+	using Sampler::model_to_string;
+	/*
+	 * Returns whether SMTSampler supports the formula, which it does not with Int or Real variables.
+	 */
+	bool smtsampler_supported(){
+		return num_ints == 0 && num_reals == 0;
+	}
+};
+
+static std::string hex_string(int bits, unsigned seed){
+	std::string s;
+	for (int i = 0; i < (bits + 3) / 4; i++){
+		seed = seed * 1103515245u + 12345u;
+		s += "0123456789abcdef"[(seed >> 16) & 15];
+	}
+	return s;
+}
+
+static void write_file(const std::string & path, const std::string & text){
+	std::ofstream out(path);
+	out << text;
+}
+
+static std::string wide_formula(){
+	std::ostringstream f;
+	f << "(set-logic QF_BV)\n";
+	for (int i = 0; i < 16; i++){
+		f << "(declare-const w" << i << " (_ BitVec 512))\n";
+	}
+	for (int i = 0; i + 1 < 16; i++){
+		f << "(assert (bvult w" << i << " w" << i + 1 << "))\n";
+		f << "(assert (not (= ((_ extract 7 0) w" << i << ") ((_ extract 15 8) w" << i + 1 << "))))\n";
+	}
+	return f.str();
+}
+
+/*
+ * 8 bit-vectors of 32 bits, all fixed except for their 4 low bits
+ */
+static std::string fixed_formula(){
+	std::ostringstream f;
+	f << "(set-logic QF_BV)\n";
+	for (int i = 0; i < 8; i++){
+		f << "(declare-const v" << i << " (_ BitVec 32))\n";
+		f << "(assert (= ((_ extract 31 4) v" << i << ") ((_ extract 31 4) (bvmul (_ bv12345 32) (_ bv" << i + 3 << " 32)))))\n";
+	}
+	return f.str();
+}
+
+static std::string array_formula(){
+	std::ostringstream f;
+	f << "(set-logic QF_ABV)\n";
+	for (int i = 0; i < 8; i++){
+		f << "(declare-const a" << i << " (Array (_ BitVec 32) (_ BitVec 32)))\n";
+	}
+	for (int i = 0; i < 8; i++){
+		for (int k = 0; k < 8; k++){
+			f << "(assert (bvult (select a" << i << " (_ bv" << k << " 32)) (bvadd (select a" << (i + 1) % 8 << " (_ bv" << k + 1 << " 32)) (_ bv" << 1000 * (k + 1) << " 32))))\n";
+		}
+	}
+	return f.str();
+}
+
+/*
+ * Returns up to n different models of the formula of s, blocking the constant values of every previous one.
+ */
+static std::vector<z3::model> distinct_models(SMTSampler & s, int n){
+	z3::context & c = s.get_context();
+	z3::solver solver(c);
+	solver.add(s.get_formula());
+	std::vector<z3::model> models;
+	while ((int)models.size() < n && solver.check() == z3::sat){
+		z3::model m = solver.get_model();
+		models.push_back(m);
+		z3::expr_vector differ(c);
+		for (const z3::func_decl & v : s.get_ind()){
+			if (v.is_const() && !v.range().is_array()){
+				differ.push_back(v() != m.eval(v(), true));
+			}
+		}
+		if (differ.empty()){
+			break;
+		}
+		solver.add(z3::mk_or(differ));
+	}
+	return models;
+}
+
+/*
+ * Returns whether the SMTSampler benchmarks were run as well.
+ */
+static bool bench_fixture(const std::string & name, const std::string & path){
+	BenchSampler sampler(path);
+	z3::model sm = sampler.solve_once();
+	bench(name, "Sampler::model_to_string", [&]{ sink = sampler.model_to_string(sm).size(); });
+	if (!sampler.smtsampler_supported()){
+		printf("%-22s %-32s\n", name.c_str(), "SMTSampler skipped (Int or Real variables)");
+		return false;
+	}
+
+	SMTSampler s(path, 1000000, 3600.0, STRAT_SMTBIT);
+	s.parse_formula();
+	std::vector<z3::model> models = distinct_models(s, 3);
+	if (models.empty()){
+		return true;
+	}
+	while (models.size() < 3){
+		models.push_back(models[0]);
+	}
+	const z3::model & m = models[0];
+	std::vector<z3::func_decl> ind = s.get_ind();
+	std::string a = s.model_string(models[0], ind);
+	std::string b = s.model_string(models[1], ind);
+	std::string c = s.model_string(models[2], ind);
+	bench(name, "SMTSampler::model_string", [&]{ sink = s.model_string(m, ind).size(); });
+	bench(name, "gen_model", [&]{ sink = s.gen_model(a, ind).size(); });
+	bench(name, "combine_models", [&]{ sink = s.combine_models(a, b, c).size(); });
+	if (!ind.empty() && ind[0].range().is_array()){
+		z3::sort range = ind[0].range().array_range();
+		bench(name, "combine_function", [&]{
+			size_t pos_a = 0, pos_b = 0, pos_c = 0;
+			std::string candidate;
+			s.combine_function(a, b, c, pos_a, pos_b, pos_c, 0, range, candidate);
+			sink = candidate.size();
+		});
+	}
+	z3::expr formula = s.get_formula();
+	bench(name, "evaluate", [&]{ sink = (size_t)(Z3_ast)s.evaluate(m, formula, true, 0); });
+	return true;
+}
+
+/*
+ * Runs the flip phase of SMTSampler around the same FLIP_EPOCHS models, with one query per bit and with batched
+ * queries. The flips of later epochs are ordered by what the earlier ones learned, so each epoch is reported.
+ */
+static void bench_flips(const std::string & name, const std::string & path){
+	for (bool batch : {false, true}){
+		SMTSampler s(path, 1000000, 3600.0, STRAT_SMTBIT);
+		s.set_seed(1);
+		s.set_batch_flips(batch);
+		s.parse_formula();
+		s.assert_formula();
+		std::vector<z3::model> models = distinct_models(s, FLIP_EPOCHS);
+		std::unordered_set<std::string> mutations;
+		for (size_t epoch = 0; epoch < models.size(); epoch++){
+			int calls = s.get_solver_calls();
+			int flips = s.get_flips();
+			uint64_t start = monotonic_ns();
+			s.flip_bits(models[epoch], s.model_string(models[epoch], s.get_ind()), mutations);
+			double ms = (monotonic_ns() - start) / 1.0e6;
+			std::string phase = std::string(batch ? "flip_bits (batched)" : "flip_bits") + " epoch " + std::to_string(epoch + 1);
+			printf("%-22s %-32s %14.1f ms %10d calls %6d flips %6d fixed bits %6d arms\n", name.c_str(), phase.c_str(),
+					ms, s.get_solver_calls() - calls, s.get_flips() - flips, s.get_unsat_ind_count(), s.get_flip_arms());
+			fflush(stdout);
+		}
+	}
+}
+
+int main(int argc, char * argv[]){
+	for (int i = 1; i + 1 < argc; i += 2){
+		if (strcmp(argv[i], "-m") == 0){
+			min_time_ms = atof(argv[i + 1]);
+		} else {
+			std::cerr << "Unknown option " << argv[i] << '\n';
+			return 1;
+		}
+	}
+	mkdir("formulas", 0755);
+	// copies of the examples, since the samplers write their .samples file next to the formula
+	std::vector<std::string> examples;
+	if (DIR * dir = opendir("../examples")){
+		while (struct dirent * entry = readdir(dir)){
+			std::string file = entry->d_name;
+			if (file.size() > 5 && file.compare(file.size() - 5, 5, ".smt2") == 0){
+				examples.push_back(file.substr(0, file.size() - 5));
+			}
+		}
+		closedir(dir);
+	}
+	std::sort(examples.begin(), examples.end());
+	std::vector<std::pair<std::string, std::string>> fixtures;
+	for (const std::string & example : examples){
+		std::ifstream in("../examples/" + example + ".smt2");
+		std::stringstream text;
+		text << in.rdbuf();
+		std::string path = std::string("formulas/micro_") + example + ".smt2";
+		write_file(path, text.str());
+		fixtures.push_back({example, path});
+	}
+	write_file("formulas/micro_wide.smt2", wide_formula());
+	fixtures.push_back({"wide", "formulas/micro_wide.smt2"});
+	write_file("formulas/micro_arrays.smt2", array_formula());
+	fixtures.push_back({"arrays", "formulas/micro_arrays.smt2"});
+
+	std::unordered_set<std::string> supported;
+	for (const auto & f : fixtures){
+		// the samplers print their formula statistics while loading, keep them out of the results
+		std::cout.setstate(std::ios::failbit);
+		if (bench_fixture(f.first, f.second)){
+			supported.insert(f.first);
+		}
+		std::cout.clear();
+	}
+
+	write_file("formulas/micro_fixed.smt2", fixed_formula());
+	std::cout.setstate(std::ios::failbit);
+	for (const std::string & example : examples){
+		if (supported.count(example)){
+			bench_flips(example, "formulas/micro_" + example + ".smt2");
+		}
+	}
+	bench_flips("fixed", "formulas/micro_fixed.smt2");
+	std::cout.clear();
+
+	z3::context ctx;
+	for (int bits : {32, 256, 4096}){
+		std::string fixture = "bv" + std::to_string(bits);
+		z3::sort s = ctx.bv_sort(bits);
+		std::string x = hex_string(bits, 1), y = hex_string(bits, 2), z = hex_string(bits, 3);
+		Z3_ast numeral = parse_bv(x.c_str(), s, ctx);
+		SMTSampler sampler("formulas/micro_wide.smt2", 1000000, 3600.0, STRAT_SMTBIT);
+		bench(fixture, "parse_bv", [&]{ sink = (size_t)parse_bv(x.c_str(), s, ctx); });
+		bench(fixture, "bv_string", [&]{ sink = bv_string(numeral, ctx).size(); });
+		bench(fixture, "combine", [&]{ sink = sampler.combine(x.c_str(), y.c_str(), z.c_str(), s).size(); });
+	}
+	return 0;
+}
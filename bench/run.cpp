@@ -0,0 +1,204 @@
+/*
+ * run.cpp
+ *
+ *  Benchmark runner: generates a fixed suite of formulas and runs every applicable strategy on each.
+ *
+ *  usage: run [-s sampler] [-e epochs] [-t seconds] [-o prefix]
+ *
+ *  Reports samples per second, unique ratio, share of time spent in the solver and peak RSS
+ *  of every run in <prefix>.csv and <prefix>.json (default prefix: results).
+ *  Everything is generated locally, so the suite runs offline and is comparable across commits.
+ */
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct BenchCase{
+	const char * logic;
+	int variables;
+	int width;
+	int depth;
+	double density;
+	unsigned seed;
+};
+
+/*
+ * The suite. Changing it makes results incomparable with earlier commits, so only append to it.
+ */
+static const BenchCase suite[] = {
+	{"QF_BV", 8, 32, 2, 1.0, 1},
+	{"QF_BV", 32, 32, 3, 1.5, 2},
+	{"QF_BV", 16, 64, 2, 0.5, 3},
+	{"QF_BV", 64, 8, 4, 2.0, 4},
+	{"QF_LIA", 8, 16, 2, 1.0, 5},
+	{"QF_LIA", 32, 16, 3, 1.0, 6},
+	{"QF_LIA", 64, 12, 2, 2.0, 7},
+	{"QF_ABV", 8, 32, 2, 1.0, 8},
+	{"QF_ABV", 24, 16, 3, 1.5, 9},
+};
+
+struct BenchResult{
+	std::string formula;
+	std::string strategy;
+	bool completed = false;
+	double total_time = 0.0;
+	double solver_time = 0.0;
+	long valid = 0;
+	long unique = 0;
+	long peak_rss_kb = 0;
+};
+
+/*
+ * Runs argv with stdout redirected to output, killing it after timeout seconds.
+ * Returns true if it exited normally; usage receives its resource usage.
+ */
+static bool run_process(const std::vector<std::string> & args, const std::string & output, double timeout, struct rusage * usage){
+	pid_t pid = fork();
+	if (pid < 0){
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0){
+		int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0){
+			perror(output.c_str());
+			_exit(127);
+		}
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+		std::vector<char *> argv;
+		for (const std::string & a : args){
+			argv.push_back(const_cast<char *>(a.c_str()));
+		}
+		argv.push_back(NULL);
+		execv(argv[0], argv.data());
+		perror(argv[0]);
+		_exit(127);
+	}
+	int status = 0;
+	double waited = 0.0;
+	while (true){
+		pid_t r = wait4(pid, &status, WNOHANG, usage);
+		if (r == pid){
+			break;
+		}
+		if (waited >= timeout){
+			kill(pid, SIGKILL);
+			wait4(pid, &status, 0, usage);
+			break;
+		}
+		usleep(10000);
+		waited += 0.01;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ * Returns the number following prefix on the last line of text that starts with it (0 if none).
+ */
+static double find_value(const std::string & text, const std::string & prefix){
+	double value = 0.0;
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line)){
+		if (line.compare(0, prefix.size(), prefix) == 0){
+			value = atof(line.c_str() + prefix.size());
+		}
+	}
+	return value;
+}
+
+static std::vector<const char *> strategies_for(const std::string & logic){
+	if (logic == "QF_LIA"){
+		return {"smtbit", "smtbv", "polytope", "randphase"};
+	}
+	return {"smtbit", "smtbv", "gf2", "randphase"};
+}
+
+int main(int argc, char * argv[]){
+	std::string sampler = "../smtsampler";
+	std::string generator = "./generate";
+	std::string prefix = "results";
+	int epochs = 20;
+	double max_time = 30.0;
+	for (int i = 1; i + 1 < argc; i += 2){
+		if (strcmp(argv[i], "-s") == 0)
+			sampler = argv[i + 1];
+		else if (strcmp(argv[i], "-e") == 0)
+			epochs = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-t") == 0)
+			max_time = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-o") == 0)
+			prefix = argv[i + 1];
+		else {
+			std::cerr << "Unknown option " << argv[i] << '\n';
+			return 1;
+		}
+	}
+	mkdir("formulas", 0755);
+
+	std::vector<BenchResult> results;
+	for (const BenchCase & b : suite){
+		std::ostringstream name;
+		name << "formulas/" << b.logic << "_v" << b.variables << "_w" << b.width << "_d" << b.depth << "_c" << b.density << "_s" << b.seed << ".smt2";
+		struct rusage usage;
+		std::vector<std::string> gen_args = {generator, b.logic, std::to_string(b.variables), std::to_string(b.width),
+				std::to_string(b.depth), std::to_string(b.density), std::to_string(b.seed)};
+		if (!run_process(gen_args, name.str(), 60.0, &usage)){
+			std::cerr << "Could not generate " << name.str() << '\n';
+			return 1;
+		}
+		for (const char * strategy : strategies_for(b.logic)){
+			BenchResult r;
+			r.formula = name.str();
+			r.strategy = strategy;
+			std::string log = name.str() + "." + strategy + ".log";
+			std::vector<std::string> args = {sampler, "-e", std::to_string(epochs), "-t", std::to_string(max_time),
+					"--seed", std::to_string(b.seed), std::string("--") + strategy, name.str()};
+			// the time limit is also enforced here, in case the sampler overruns it
+			r.completed = run_process(args, log, 2 * max_time + 10.0, &usage);
+			r.peak_rss_kb = usage.ru_maxrss;
+			std::ifstream in(log);
+			std::stringstream text;
+			text << in.rdbuf();
+			r.total_time = find_value(text.str(), "total time: ");
+			r.solver_time = find_value(text.str(), "maxsmt time: ") + find_value(text.str(), "smt time: ")
+					+ find_value(text.str(), "gf2 time: ");
+			r.valid = find_value(text.str(), "Models (with repetitions): ");
+			r.unique = find_value(text.str(), "Unique models (# samples in file): ");
+			std::cout << r.formula << ' ' << r.strategy << ": " << r.unique << " unique samples in " << r.total_time << "s"
+					<< (r.completed ? "" : " (did not complete)") << '\n' << std::flush;
+			results.push_back(r);
+		}
+	}
+
+	std::ofstream csv(prefix + ".csv");
+	std::ofstream json(prefix + ".json");
+	csv << "formula,strategy,completed,total_time,samples_per_sec,unique_ratio,solver_time_share,peak_rss_kb\n";
+	json << "[\n";
+	for (size_t i = 0; i < results.size(); i++){
+		const BenchResult & r = results[i];
+		double rate = r.total_time > 0 ? r.unique / r.total_time : 0.0;
+		double unique_ratio = r.valid > 0 ? (double)r.unique / r.valid : 0.0;
+		double solver_share = r.total_time > 0 ? r.solver_time / r.total_time : 0.0;
+		csv << r.formula << ',' << r.strategy << ',' << r.completed << ',' << r.total_time << ',' << rate << ','
+				<< unique_ratio << ',' << solver_share << ',' << r.peak_rss_kb << '\n';
+		json << "  {\"formula\": \"" << r.formula << "\", \"strategy\": \"" << r.strategy << "\", \"completed\": " << (r.completed ? "true" : "false")
+				<< ", \"total_time\": " << r.total_time << ", \"samples_per_sec\": " << rate << ", \"unique_ratio\": " << unique_ratio
+				<< ", \"solver_time_share\": " << solver_share << ", \"peak_rss_kb\": " << r.peak_rss_kb << '}'
+				<< (i + 1 < results.size() ? "," : "") << '\n';
+	}
+	json << "]\n";
+	std::cout << "Results written to " << prefix << ".csv and " << prefix << ".json\n";
+	return 0;
+}
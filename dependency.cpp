@@ -0,0 +1,250 @@
+/*
+ * dependency.cpp
+ *
+ *  Detection of variables that are functionally defined by other variables.
+ */
+#include "dependency.h"
+#include "timers.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+
+static void collect_conjuncts(const z3::expr & e, std::vector<z3::expr> & conjuncts){
+	if (e.is_app() && e.decl().decl_kind() == Z3_OP_AND){
+		for (unsigned i = 0; i < e.num_args(); i++){
+			collect_conjuncts(e.arg(i), conjuncts);
+		}
+	} else {
+		conjuncts.push_back(e);
+	}
+}
+
+static void collect_variables(const z3::expr & e, std::unordered_set<Z3_func_decl> & vars, std::unordered_set<Z3_ast> & visited){
+	if (!visited.insert(e).second || !e.is_app()){
+		return;
+	}
+	z3::func_decl fd = e.decl();
+	if (fd.decl_kind() == Z3_OP_UNINTERPRETED){
+		vars.insert(fd);
+	}
+	for (unsigned i = 0; i < e.num_args(); i++){
+		collect_variables(e.arg(i), vars, visited);
+	}
+}
+
+// whether target is reachable from v following the dependencies of defined variables
+static bool depends_on(Z3_func_decl v, Z3_func_decl target, const std::unordered_map<Z3_func_decl, std::unordered_set<Z3_func_decl>> & deps, std::unordered_set<Z3_func_decl> & visited){
+	if (v == target){
+		return true;
+	}
+	if (!visited.insert(v).second){
+		return false;
+	}
+	auto it = deps.find(v);
+	if (it == deps.end()){
+		return false;
+	}
+	for (Z3_func_decl u : it->second){
+		if (depends_on(u, target, deps, visited)){
+			return true;
+		}
+	}
+	return false;
+}
+
+static void topological_order(Z3_func_decl v, const std::unordered_map<Z3_func_decl, std::unordered_set<Z3_func_decl>> & deps, const std::unordered_map<Z3_func_decl, size_t> & def_index,
+		const std::vector<std::pair<z3::func_decl, z3::expr>> & definitions, std::unordered_set<Z3_func_decl> & done, std::vector<std::pair<z3::func_decl, z3::expr>> & ordered){
+	auto idx = def_index.find(v);
+	if (idx == def_index.end() || !done.insert(v).second){
+		return;
+	}
+	for (Z3_func_decl u : deps.at(v)){
+		topological_order(u, deps, def_index, definitions, done, ordered);
+	}
+	ordered.push_back(definitions[idx->second]);
+}
+
+std::vector<std::pair<z3::func_decl, z3::expr>> find_definitions(const z3::expr & formula){
+	std::vector<z3::expr> conjuncts;
+	collect_conjuncts(formula, conjuncts);
+	std::vector<std::pair<z3::func_decl, z3::expr>> definitions;
+	std::unordered_map<Z3_func_decl, std::unordered_set<Z3_func_decl>> deps;
+	std::unordered_map<Z3_func_decl, size_t> def_index;
+	for (z3::expr & e : conjuncts){
+		if (!e.is_app() || e.num_args() != 2 || (e.decl().decl_kind() != Z3_OP_EQ && e.decl().decl_kind() != Z3_OP_IFF)){
+			continue;
+		}
+		for (int side = 0; side < 2; side++){
+			z3::expr lhs = e.arg(side);
+			z3::expr rhs = e.arg(1 - side);
+			if (!lhs.is_const() || lhs.decl().decl_kind() != Z3_OP_UNINTERPRETED || lhs.is_array()){
+				continue;
+			}
+			Z3_func_decl x = lhs.decl();
+			if (deps.find(x) != deps.end()){
+				continue; // already defined
+			}
+			std::unordered_set<Z3_func_decl> rhs_vars;
+			std::unordered_set<Z3_ast> visited;
+			collect_variables(rhs, rhs_vars, visited);
+			bool cyclic = false;
+			for (Z3_func_decl v : rhs_vars){
+				std::unordered_set<Z3_func_decl> seen;
+				if (depends_on(v, x, deps, seen)){
+					cyclic = true;
+					break;
+				}
+			}
+			if (cyclic){
+				continue;
+			}
+			deps[x] = rhs_vars;
+			def_index[x] = definitions.size();
+			definitions.push_back(std::make_pair(lhs.decl(), rhs));
+			break;
+		}
+	}
+	std::vector<std::pair<z3::func_decl, z3::expr>> ordered;
+	std::unordered_set<Z3_func_decl> done;
+	for (auto & def : definitions){
+		topological_order(def.first, deps, def_index, definitions, done, ordered);
+	}
+	return ordered;
+}
+
+std::vector<z3::func_decl> independent_variables(const std::vector<z3::func_decl> & variables, const std::vector<std::pair<z3::func_decl, z3::expr>> & definitions){
+	std::unordered_set<Z3_func_decl> defined;
+	for (auto & def : definitions){
+		defined.insert(def.first);
+	}
+	std::vector<z3::func_decl> ind;
+	for (const z3::func_decl & v : variables){
+		if (defined.find(v) == defined.end()){
+			ind.push_back(v);
+		}
+	}
+	return ind;
+}
+
+std::vector<std::vector<bool>> compute_independent_support(z3::context & c, const z3::expr & formula, const std::vector<z3::func_decl> & variables,
+		const std::vector<z3::func_decl> & candidates, unsigned timeout_ms, double time_budget, unsigned rlimit){
+	uint64_t start_ns = monotonic_ns();
+	// second copy of the formula over fresh constants
+	z3::expr_vector src(c);
+	z3::expr_vector dst(c);
+	std::unordered_map<Z3_func_decl, unsigned> copy_index;
+	for (const z3::func_decl & v : variables){
+		if (v.arity() > 0 || v.range().is_array()){
+			continue;
+		}
+		copy_index[v] = src.size();
+		src.push_back(v());
+		dst.push_back(z3::expr(c, Z3_mk_fresh_const(c, v.name().str().c_str(), v.range())));
+	}
+	z3::expr copy = formula;
+	copy = copy.substitute(src, dst);
+	z3::solver s(c);
+	z3::params p(c);
+	if (rlimit){
+		p.set("timeout", UINT_MAX); // no timeout
+		p.set("rlimit", rlimit);
+	} else {
+		p.set("timeout", timeout_ms);
+	}
+	s.set(p);
+	s.add(formula);
+	s.add(copy);
+	// unit u of the support: the copies agree on u under assumption same[u], disagree under assumption differ[u]
+	std::vector<std::pair<int, unsigned>> units;
+	z3::expr_vector same(c);
+	z3::expr_vector differ(c);
+	std::vector<std::vector<bool>> support;
+	for (size_t i = 0; i < candidates.size(); i++){
+		z3::sort srt = candidates[i].range();
+		unsigned size = srt.is_bv() ? srt.bv_size() : 1;
+		support.push_back(std::vector<bool>(size, true));
+		auto idx = copy_index.find(candidates[i]);
+		if (idx == copy_index.end()){
+			continue; // shared by both copies
+		}
+		z3::expr x = src[idx->second];
+		z3::expr y = dst[idx->second];
+		for (unsigned bit = 0; bit < size; bit++){
+			z3::expr eq = srt.is_bv() ? x.extract(bit, bit) == y.extract(bit, bit) : x == y;
+			z3::expr same_lit = z3::expr(c, Z3_mk_fresh_const(c, "same", c.bool_sort()));
+			z3::expr differ_lit = z3::expr(c, Z3_mk_fresh_const(c, "differ", c.bool_sort()));
+			s.add(z3::implies(same_lit, eq));
+			s.add(z3::implies(differ_lit, !eq));
+			same.push_back(same_lit);
+			differ.push_back(differ_lit);
+			units.push_back(std::make_pair(i, bit));
+		}
+	}
+	std::vector<bool> in_support(units.size(), true);
+	for (size_t u = 0; u < units.size(); u++){
+		if (!rlimit && (monotonic_ns() - start_ns) / 1.0e9 > time_budget){
+			std::cout << "Independent support: time budget reached after " << u << " / " << units.size() << " checks\n";
+			break;
+		}
+		z3::expr_vector assumptions(c);
+		for (size_t w = 0; w < units.size(); w++){
+			if (w != u && in_support[w]){
+				assumptions.push_back(same[w]);
+			}
+		}
+		assumptions.push_back(differ[u]);
+		if (s.check(assumptions) == z3::unsat){ // u is defined by the rest of the support
+			in_support[u] = false;
+			support[units[u].first][units[u].second] = false;
+		}
+	}
+	return support;
+}
+
+static void mark_used_bits(const z3::expr & e, std::unordered_map<Z3_func_decl, std::vector<bool>> & used, std::unordered_set<Z3_ast> & visited){
+	if (!visited.insert(e).second || !e.is_app()){
+		return;
+	}
+	z3::func_decl fd = e.decl();
+	if (e.is_const() && fd.decl_kind() == Z3_OP_UNINTERPRETED){
+		auto it = used.find(fd);
+		if (it != used.end()){
+			std::fill(it->second.begin(), it->second.end(), true);
+		}
+		return;
+	}
+	if (fd.decl_kind() == Z3_OP_EXTRACT && e.arg(0).is_const() && e.arg(0).decl().decl_kind() == Z3_OP_UNINTERPRETED){
+		// only the extracted bits of the variable are read here
+		auto it = used.find(e.arg(0).decl());
+		if (it != used.end()){
+			int hi = Z3_get_decl_int_parameter(e.ctx(), fd, 0);
+			int lo = Z3_get_decl_int_parameter(e.ctx(), fd, 1);
+			for (int i = lo; i <= hi; i++){
+				it->second[i] = true;
+			}
+		}
+		return;
+	}
+	for (unsigned i = 0; i < e.num_args(); i++){
+		mark_used_bits(e.arg(i), used, visited);
+	}
+}
+
+std::vector<std::vector<bool>> used_bits(const z3::expr & formula, const std::vector<z3::func_decl> & variables){
+	std::unordered_map<Z3_func_decl, std::vector<bool>> used;
+	for (const z3::func_decl & v : variables){
+		if (v.arity() == 0 && !v.range().is_array()){
+			used[v] = std::vector<bool>(v.range().is_bv() ? v.range().bv_size() : 1, false);
+		}
+	}
+	std::unordered_set<Z3_ast> visited;
+	mark_used_bits(formula, used, visited);
+	std::vector<std::vector<bool>> res;
+	for (const z3::func_decl & v : variables){
+		auto it = used.find(v);
+		res.push_back(it == used.end() ? std::vector<bool>(1, true) : it->second);
+	}
+	return res;
+}
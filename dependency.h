@@ -0,0 +1,48 @@
+/*
+ * dependency.h
+ *
+ *  Detection of variables that are functionally defined by other variables.
+ */
+
+#ifndef DEPENDENCY_H_
+#define DEPENDENCY_H_
+
+#include <z3++.h>
+#include <vector>
+
+/*
+ * Finds variables defined by a top-level equality x = f(y, z) of formula, where x does not occur in f.
+ * Definitions are chosen greedily so that no variable (transitively) depends on itself.
+ * They are returned in topological order: a definition only mentions independent variables
+ * and variables defined earlier in the returned vector.
+ */
+std::vector<std::pair<z3::func_decl, z3::expr>> find_definitions(const z3::expr & formula);
+
+/*
+ * Returns the variables that are not defined by any of the given definitions.
+ */
+std::vector<z3::func_decl> independent_variables(const std::vector<z3::func_decl> & variables, const std::vector<std::pair<z3::func_decl, z3::expr>> & definitions);
+
+/*
+ * Computes an independent support of formula at the bit level, using Padoa's definability check:
+ * a bit is dropped from the support if two copies of the formula that agree on the remaining
+ * support bits cannot disagree on it.
+ * All constants in variables are copied, arrays and uninterpreted functions are shared by both copies
+ * (so they are implicitly part of the support).
+ * Bits of candidates are checked greedily, each check limited to timeout_ms, until time_budget seconds passed
+ * (unchecked bits stay in the support). If rlimit is not 0, each check is limited to rlimit resources instead
+ * and all bits are checked, so that the support does not depend on the speed of the machine.
+ * Variables that are not candidates never belong to the support.
+ * Returns, for each candidate, which of its bits are in the support (a single entry for Bools and Ints).
+ */
+std::vector<std::vector<bool>> compute_independent_support(z3::context & c, const z3::expr & formula, const std::vector<z3::func_decl> & variables,
+		const std::vector<z3::func_decl> & candidates, unsigned timeout_ms, double time_budget, unsigned rlimit);
+
+/*
+ * Marks, for each constant in variables, the bits that can influence the truth value of formula:
+ * a bit is unused if the variable only occurs under extracts that do not cover it.
+ * Bools and Ints have a single entry, arrays and uninterpreted functions are always considered used.
+ */
+std::vector<std::vector<bool>> used_bits(const z3::expr & formula, const std::vector<z3::func_decl> & variables);
+
+#endif /* DEPENDENCY_H_ */
@@ -0,0 +1,241 @@
+/*
+ * gf2.cpp
+ *
+ *  Affine GF(2) subsystem of a formula (xor/parity constraints over bits),
+ *  solved by bit-packed Gaussian elimination and sampled uniformly.
+ */
+#include "gf2.h"
+#include "sampler.h" // for bv_string
+#include <cstdlib>
+
+GF2System::GF2System(z3::context & c) : c(c){
+}
+
+void GF2System::extract(const z3::expr & formula){
+	columns.clear();
+	column_index.clear();
+	equations.clear();
+	nonlinear.clear();
+	pivots.clear();
+	consistent = true;
+	add_conjuncts(formula);
+	eliminate();
+}
+
+void GF2System::add_conjuncts(const z3::expr & e){
+	if (e.is_app() && e.decl().decl_kind() == Z3_OP_AND){
+		for (unsigned i = 0; i < e.num_args(); i++){
+			add_conjuncts(e.arg(i));
+		}
+	} else if (!add_equations(e)){
+		nonlinear.push_back(e);
+	}
+}
+
+bool GF2System::add_equations(const z3::expr & e){
+	size_t num_columns = columns.size();
+	std::vector<Equation> eqs;
+	bool linear = true;
+	if (e.is_app() && e.decl().decl_kind() == Z3_OP_EQ && e.arg(0).is_bv()){
+		// one equation per bit: lhs[i] + rhs[i] = 0
+		for (unsigned i = 0; i < e.arg(0).get_sort().bv_size() && linear; i++){
+			Equation eq;
+			linear = linear_bit(e.arg(0), i, eq) && linear_bit(e.arg(1), i, eq);
+			eqs.push_back(eq);
+		}
+	} else {
+		// the conjunct must be true: L(e) = 1
+		Equation eq;
+		linear = linear_bool(e, eq);
+		eq.constant = !eq.constant;
+		eqs.push_back(eq);
+	}
+	if (!linear){
+		// forget the columns introduced by this conjunct
+		for (size_t i = num_columns; i < columns.size(); i++){
+			column_index.erase(std::make_pair((Z3_func_decl)columns[i].first, columns[i].second));
+		}
+		columns.erase(columns.begin() + num_columns, columns.end());
+		return false;
+	}
+	equations.insert(equations.end(), eqs.begin(), eqs.end());
+	return true;
+}
+
+// eq accumulates the affine form of e, where true is 1
+bool GF2System::linear_bool(const z3::expr & e, Equation & eq){
+	if (!e.is_app()){
+		return false;
+	}
+	z3::func_decl fd = e.decl();
+	switch (fd.decl_kind()){
+		case Z3_OP_TRUE:
+			eq.constant = !eq.constant;
+			return true;
+		case Z3_OP_FALSE:
+			return true;
+		case Z3_OP_NOT:
+			eq.constant = !eq.constant;
+			return linear_bool(e.arg(0), eq);
+		case Z3_OP_XOR:
+			for (unsigned i = 0; i < e.num_args(); i++){
+				if (!linear_bool(e.arg(i), eq)){
+					return false;
+				}
+			}
+			return true;
+		case Z3_OP_EQ:
+		case Z3_OP_IFF:
+			// (a = b) is 1 + a + b, only for booleans and single bits
+			if (e.num_args() != 2){
+				return false;
+			}
+			eq.constant = !eq.constant;
+			if (e.arg(0).is_bool()){
+				return linear_bool(e.arg(0), eq) && linear_bool(e.arg(1), eq);
+			}
+			if (e.arg(0).is_bv() && e.arg(0).get_sort().bv_size() == 1){
+				return linear_bit(e.arg(0), 0, eq) && linear_bit(e.arg(1), 0, eq);
+			}
+			return false;
+		case Z3_OP_UNINTERPRETED:
+			if (e.is_const()){
+				toggle(eq, column(fd, 0));
+				return true;
+			}
+			return false;
+		default:
+			return false;
+	}
+}
+
+// eq accumulates the affine form of bit number bit of the bit-vector e
+bool GF2System::linear_bit(const z3::expr & e, unsigned bit, Equation & eq){
+	if (!e.is_app()){
+		return false;
+	}
+	if (e.is_numeral()){
+		std::string s = bv_string(e, c); // hex digits, most significant first
+		unsigned digit = s.size() - 1 - bit / 4;
+		unsigned char h = s[digit] <= '9' ? s[digit] - '0' : 10 + s[digit] - 'a';
+		if ((h >> (bit % 4)) & 1){
+			eq.constant = !eq.constant;
+		}
+		return true;
+	}
+	z3::func_decl fd = e.decl();
+	switch (fd.decl_kind()){
+		case Z3_OP_UNINTERPRETED:
+			if (e.is_const()){
+				toggle(eq, column(fd, bit));
+				return true;
+			}
+			return false;
+		case Z3_OP_BXOR:
+			for (unsigned i = 0; i < e.num_args(); i++){
+				if (!linear_bit(e.arg(i), bit, eq)){
+					return false;
+				}
+			}
+			return true;
+		case Z3_OP_BNOT:
+			eq.constant = !eq.constant;
+			return linear_bit(e.arg(0), bit, eq);
+		case Z3_OP_EXTRACT:
+			return linear_bit(e.arg(0), bit + Z3_get_decl_int_parameter(c, fd, 1), eq);
+		case Z3_OP_CONCAT:
+			// the last argument holds the least significant bits
+			for (int i = e.num_args() - 1; i >= 0; i--){
+				unsigned size = e.arg(i).get_sort().bv_size();
+				if (bit < size){
+					return linear_bit(e.arg(i), bit, eq);
+				}
+				bit -= size;
+			}
+			return false;
+		default:
+			return false;
+	}
+}
+
+void GF2System::toggle(Equation & eq, int col){
+	if (eq.bits.size() <= (size_t)col / 64){
+		eq.bits.resize(col / 64 + 1, 0);
+	}
+	eq.bits[col / 64] ^= (uint64_t)1 << (col % 64);
+}
+
+int GF2System::column(const z3::func_decl & v, unsigned bit){
+	std::pair<Z3_func_decl, unsigned> key((Z3_func_decl)v, bit);
+	auto it = column_index.find(key);
+	if (it != column_index.end()){
+		return it->second;
+	}
+	columns.push_back(std::make_pair(v, bit));
+	column_index[key] = columns.size() - 1;
+	return columns.size() - 1;
+}
+
+void GF2System::eliminate(){
+	size_t words = (columns.size() + 63) / 64;
+	for (Equation & eq : equations){
+		eq.bits.resize(words, 0);
+	}
+	size_t rank = 0;
+	for (size_t col = 0; col < columns.size() && rank < equations.size(); col++){
+		size_t w = col / 64;
+		uint64_t mask = (uint64_t)1 << (col % 64);
+		size_t r = rank;
+		while (r < equations.size() && !(equations[r].bits[w] & mask)){
+			r++;
+		}
+		if (r == equations.size()){
+			continue; // free column
+		}
+		std::swap(equations[r], equations[rank]);
+		// reduced row echelon form: clear the pivot column in every other row
+		for (size_t i = 0; i < equations.size(); i++){
+			if (i != rank && (equations[i].bits[w] & mask)){
+				for (size_t k = 0; k < words; k++){
+					equations[i].bits[k] ^= equations[rank].bits[k];
+				}
+				equations[i].constant ^= equations[rank].constant;
+			}
+		}
+		pivots.push_back(col);
+		rank++;
+	}
+	// remaining rows are 0 = constant
+	for (size_t i = rank; i < equations.size(); i++){
+		if (equations[i].constant){
+			consistent = false;
+		}
+	}
+	equations.resize(rank);
+}
+
+void GF2System::sample(std::vector<bool> & values, Random & rng){
+	size_t words = (columns.size() + 63) / 64;
+	std::vector<uint64_t> assignment(words, 0);
+	// free columns take 64 random bits per draw, pivot columns are overwritten below
+	for (size_t k = 0; k < words; k++){
+		assignment[k] = rng.next();
+	}
+	for (int p : pivots){
+		assignment[p / 64] &= ~((uint64_t)1 << (p % 64));
+	}
+	// each pivot equals its row constant plus the free columns of its row
+	for (size_t r = 0; r < pivots.size(); r++){
+		int parity = equations[r].constant;
+		for (size_t k = 0; k < words; k++){
+			parity ^= __builtin_parityll(equations[r].bits[k] & assignment[k]);
+		}
+		if (parity){
+			assignment[pivots[r] / 64] |= (uint64_t)1 << (pivots[r] % 64);
+		}
+	}
+	values.resize(columns.size());
+	for (size_t col = 0; col < columns.size(); col++){
+		values[col] = (assignment[col / 64] >> (col % 64)) & 1;
+	}
+}
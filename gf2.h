@@ -0,0 +1,62 @@
+/*
+ * gf2.h
+ *
+ *  Affine GF(2) subsystem of a formula (xor/parity constraints over bits),
+ *  solved by bit-packed Gaussian elimination and sampled uniformly.
+ */
+
+#ifndef GF2_H_
+#define GF2_H_
+
+#include <z3++.h>
+#include "random.h"
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+class GF2System{
+
+	struct Equation{
+		std::vector<uint64_t> bits; // one bit per column
+		bool constant = false; // sum of the columns equals constant
+	};
+
+	z3::context & c;
+	std::vector<std::pair<z3::func_decl, unsigned>> columns; // (variable, bit index) of each column, bit 0 for bools
+	std::map<std::pair<Z3_func_decl, unsigned>, int> column_index;
+	std::vector<Equation> equations;
+	std::vector<z3::expr> nonlinear; // top-level conjuncts that are not affine over GF(2)
+	std::vector<int> pivots; // pivot column of each row of the reduced system
+	bool consistent = true;
+
+public:
+	GF2System(z3::context & c);
+	/*
+	 * Splits the top-level conjuncts of formula into affine GF(2) equations and non-linear constraints,
+	 * then reduces the equations to row echelon form.
+	 */
+	void extract(const z3::expr & formula);
+	/*
+	 * Draws a uniformly random solution of the affine system:
+	 * free columns are chosen at random and pivot columns are back-substituted.
+	 * values[i] is the value of column i.
+	 */
+	void sample(std::vector<bool> & values, Random & rng);
+	const std::vector<std::pair<z3::func_decl, unsigned>> & get_columns() const { return columns; }
+	const std::vector<z3::expr> & get_nonlinear() const { return nonlinear; }
+	int num_equations() const { return equations.size(); }
+	int rank() const { return pivots.size(); }
+	int num_free() const { return columns.size() - pivots.size(); }
+	bool is_consistent() const { return consistent; }
+
+protected:
+	void add_conjuncts(const z3::expr & e);
+	bool add_equations(const z3::expr & e);
+	bool linear_bool(const z3::expr & e, Equation & eq);
+	bool linear_bit(const z3::expr & e, unsigned bit, Equation & eq);
+	void toggle(Equation & eq, int col);
+	int column(const z3::func_decl & v, unsigned bit);
+	void eliminate();
+};
+
+#endif /* GF2_H_ */
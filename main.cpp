@@ -3,6 +3,9 @@
 #include "sampler.h"
 
 
+// epochs run with each MaxSAT engine by --maxsmt-engine auto
+static const int ENGINE_PROBE_EPOCHS = 3;
+
 int main(int argc, char * argv[]) {
     int max_epochs = 1000000;
     int max_samples = 1000000;
@@ -10,6 +13,21 @@ int main(int argc, char * argv[]) {
     int max_epoch_samples = 10000;
     double max_epoch_time = 600.0;
     int strategy = STRAT_SMTBIT;
+    double support_time = 0.0;
+    int free_fill_samples = 10;
+    std::string metrics_target;
+    double metrics_interval = 5.0;
+    std::string trace_file;
+    bool coverage = false;
+    bool auto_strategy = false;
+    bool pipelined = false;
+    int local_search_steps = 0;
+    bool flips = false;
+    bool batch_flips = false;
+    double probe_fraction = 0.05;
+    uint64_t seed = (uint64_t)time(NULL) ^ monotonic_ns();
+    unsigned rlimit = 0;
+    std::string maxsmt_engine;
     if (argc < 2) {
         std::cout << "Argument required: input file\n";
         return 0;
@@ -19,6 +37,16 @@ int main(int argc, char * argv[]) {
     bool arg_epoch_samples = false;
     bool arg_epoch_time = false;
     bool arg_num_epochs = false;
+    bool arg_support_time = false;
+    bool arg_free_fill = false;
+    bool arg_metrics = false;
+    bool arg_metrics_interval = false;
+    bool arg_trace = false;
+    bool arg_seed = false;
+    bool arg_rlimit = false;
+    bool arg_maxsmt_engine = false;
+    bool arg_probe_fraction = false;
+    bool arg_local_search = false;
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-n") == 0)
             arg_samples = true;
@@ -30,12 +58,50 @@ int main(int argc, char * argv[]) {
             arg_epoch_samples = true;
         else if (strcmp(argv[i], "-et") == 0)
             arg_epoch_time = true;
+        else if (strcmp(argv[i], "-it") == 0)
+            arg_support_time = true;
+        else if (strcmp(argv[i], "-fn") == 0)
+            arg_free_fill = true;
+        else if (strcmp(argv[i], "--metrics") == 0)
+            arg_metrics = true;
+        else if (strcmp(argv[i], "-mi") == 0)
+            arg_metrics_interval = true;
+        else if (strcmp(argv[i], "--trace") == 0)
+            arg_trace = true;
+        else if (strcmp(argv[i], "--seed") == 0)
+            arg_seed = true;
+        else if (strcmp(argv[i], "--rlimit") == 0)
+            arg_rlimit = true;
+        else if (strcmp(argv[i], "--maxsmt-engine") == 0)
+            arg_maxsmt_engine = true;
+        else if (strcmp(argv[i], "--coverage") == 0)
+            coverage = true;
+        else if (strcmp(argv[i], "--ind") == 0)
+            support_time = 60.0;
         else if (strcmp(argv[i], "--smtbit") == 0)
             strategy = STRAT_SMTBIT;
         else if (strcmp(argv[i], "--smtbv") == 0)
             strategy = STRAT_SMTBV;
         else if (strcmp(argv[i], "--sat") == 0)
             strategy = STRAT_SAT;
+        else if (strcmp(argv[i], "--polytope") == 0)
+            strategy = STRAT_POLYTOPE;
+        else if (strcmp(argv[i], "--gf2") == 0)
+            strategy = STRAT_GF2;
+        else if (strcmp(argv[i], "--randphase") == 0)
+            strategy = STRAT_RANDPHASE;
+        else if (strcmp(argv[i], "--auto") == 0)
+            auto_strategy = true;
+        else if (strcmp(argv[i], "--pipeline") == 0)
+            pipelined = true;
+        else if (strcmp(argv[i], "-af") == 0)
+            arg_probe_fraction = true;
+        else if (strcmp(argv[i], "-ls") == 0)
+            arg_local_search = true;
+        else if (strcmp(argv[i], "--flip") == 0)
+            flips = true;
+        else if (strcmp(argv[i], "--flip-batch") == 0)
+            flips = batch_flips = true;
         else if (arg_samples) {
             arg_samples = false;
             max_samples = atoi(argv[i]);
@@ -56,6 +122,46 @@ int main(int argc, char * argv[]) {
             arg_num_epochs = false;
             max_epochs = atof(argv[i]);
         }
+        else if (arg_support_time) {
+            arg_support_time = false;
+            support_time = atof(argv[i]);
+        }
+        else if (arg_free_fill) {
+            arg_free_fill = false;
+            free_fill_samples = atoi(argv[i]);
+        }
+        else if (arg_metrics) {
+            arg_metrics = false;
+            metrics_target = argv[i];
+        }
+        else if (arg_metrics_interval) {
+            arg_metrics_interval = false;
+            metrics_interval = atof(argv[i]);
+        }
+        else if (arg_trace) {
+            arg_trace = false;
+            trace_file = argv[i];
+        }
+        else if (arg_seed) {
+            arg_seed = false;
+            seed = strtoull(argv[i], NULL, 10);
+        }
+        else if (arg_rlimit) {
+            arg_rlimit = false;
+            rlimit = strtoul(argv[i], NULL, 10);
+        }
+        else if (arg_local_search) {
+            arg_local_search = false;
+            local_search_steps = atoi(argv[i]);
+        }
+        else if (arg_probe_fraction) {
+            arg_probe_fraction = false;
+            probe_fraction = atof(argv[i]);
+        }
+        else if (arg_maxsmt_engine) {
+            arg_maxsmt_engine = false;
+            maxsmt_engine = argv[i];
+        }
     }
 
     if (strategy == STRAT_SAT){
@@ -63,26 +169,45 @@ int main(int argc, char * argv[]) {
     	exit(0);
     }
 
+    if (!maxsmt_engine.empty() && maxsmt_engine != "auto" &&
+            std::find(maxsmt_engines, maxsmt_engines + num_maxsmt_engines, maxsmt_engine) == maxsmt_engines + num_maxsmt_engines){
+        std::cout<<"Unknown MaxSMT engine "<<maxsmt_engine<<std::endl;
+        exit(1);
+    }
+
+    if (!trace_file.empty())
+        trace_start(trace_file);
     MEGASampler s(argv[argc-1], max_samples, max_time, max_epoch_samples, max_epoch_time, strategy);
-	s.set_timer_on("total");
+    s.set_seed(seed);
+    if (rlimit)
+        s.set_rlimit(rlimit);
+    if (!maxsmt_engine.empty() && maxsmt_engine != "auto")
+        s.set_maxsmt_engine(maxsmt_engine);
+    s.set_support_time(support_time);
+    s.set_free_fill_samples(free_fill_samples);
+    s.set_local_search_steps(local_search_steps);
+    s.set_flips(flips, batch_flips);
+    if (!metrics_target.empty())
+        s.start_metrics(metrics_target, metrics_interval);
+    if (auto_strategy)
+        s.set_auto_strategy(probe_fraction);
     s.initialize_solvers();
-    s.set_timer_on("initial_solving");
-    s.check_if_satisfiable();
-    s.accumulate_time("initial_solving");
-    try{
-        for (int epochs=0; epochs<max_epochs; epochs++){
-        	s.set_timer_on("start_epoch");
-        	const z3::model & m = s.start_epoch();
-        	s.accumulate_time("start_epoch");
-//        	std::cout<<m<<std::endl;
-        	s.set_timer_on("do_epoch");
-        	s.do_epoch(m);
-        	s.accumulate_time("do_epoch");
-        }
-    } catch (z3::exception& except) {
-        std::cout << "Termination due to: " << except << "\n";
+    s.set_coverage(coverage);
+    {
+        ScopedTimer timer(s.get_timers(), TIMER_INITIAL_SOLVING);
+        s.check_if_satisfiable();
+    }
+    if (maxsmt_engine == "auto")
+        s.choose_maxsmt_engine(ENGINE_PROBE_EPOCHS);
+    if (auto_strategy)
+        s.tune_strategy();
+    if (pipelined && auto_strategy)
+        std::cout<<"Pipeline: not used with --auto"<<std::endl;
+    else if (pipelined)
+        s.start_pipeline();
+    for (int epochs=0; epochs<max_epochs && !s.should_stop(); epochs++){
+        s.run_epoch();
     }
-	s.accumulate_time("total");
     s.finish();
     return 0;
 
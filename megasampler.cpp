@@ -1,7 +1,21 @@
 #include "megasampler.h"
+#include "polytope.h"
+#include "dependency.h"
+#include <deque>
 #include <iostream>
 
-MEGASampler::MEGASampler(std::string input, int max_samples, double max_time, int max_epoch_samples, double max_epoch_time, int strategy): Sampler(input,max_samples,max_time,max_epoch_samples,max_epoch_time,strategy),simpl_formula(c){
+// timeout of the solver repairs of GF2 samples, until their latencies are known
+static const unsigned GF2_MAX_TIMEOUT_MS = 5000;
+
+// local search: probability of a random flip in a violated conjunct, and flips compared otherwise
+static const double LS_NOISE = 0.3;
+static const int LS_CANDIDATES = 4;
+
+// timeout of the flip queries, until their latencies are known, and the largest group of a batched flip query
+static const unsigned FLIP_MAX_TIMEOUT_MS = 5000;
+static const int MAX_FLIP_BATCH = 64;
+
+MEGASampler::MEGASampler(std::string input, int max_samples, double max_time, int max_epoch_samples, double max_epoch_time, int strategy): Sampler(input,max_samples,max_time,max_epoch_samples,max_epoch_time,strategy),simpl_formula(c),gf2(c),gf2_rest(c){
     	std::cout<<"starting MEGA"<<std::endl;
 }
 
@@ -10,6 +24,21 @@ void MEGASampler::initialize_solvers(){
 	nnf_and_simplify_formula();
     opt.add(simpl_formula); //adds formula as hard constraint to optimization solver (no weight specified for it)
     solver.add(simpl_formula); //adds formula as constraint to normal solver
+    definitions = find_definitions(original_formula); // arith_lhs rewrites x = y + 1 into x + -1*y = 1 in simpl_formula
+    ind = independent_variables(variables, definitions);
+    std::cout<<"Defined variables: "<<definitions.size()<<", independent variables: "<<ind.size()<<std::endl;
+    if (support_time > 0){
+    	compute_support();
+    }
+    compute_free_bits();
+    if (strategy == STRAT_GF2 || auto_strategy){
+    	gf2.extract(simpl_formula);
+    	for (const z3::expr & e : gf2.get_nonlinear()){
+    		gf2_rest.add(e);
+    	}
+    	gf2_rest.set(params);
+    	std::cout<<"GF2 equations: "<<gf2.num_equations()<<", bits: "<<gf2.get_columns().size()<<", rank: "<<gf2.rank()<<", free bits: "<<gf2.num_free()<<", non-linear constraints: "<<gf2.get_nonlinear().size()<<std::endl;
+    }
 }
 
 void MEGASampler::nnf_and_simplify_formula() {
@@ -22,11 +51,611 @@ void MEGASampler::nnf_and_simplify_formula() {
     z3::goal g(c);
     g.add(original_formula);
 
-    set_timer_on("conversion");
+    ScopedTimer timer(timers, TIMER_CONVERSION);
     z3::apply_result res = t_both(g);
     simpl_formula = res.as_expr();
 	std::cout<<res.as_expr()<<std::endl;
-	accumulate_time("conversion");
 
 }
 
+
+void MEGASampler::compute_support(){
+	ScopedTimer timer(timers, TIMER_INDEPENDENT_SUPPORT);
+	std::vector<std::vector<bool>> support = compute_independent_support(c, simpl_formula, variables, ind, 1000u, support_time, rlimit);
+	std::vector<z3::func_decl> new_ind;
+	int all_bits = 0;
+	int kept_bits = 0;
+	for (size_t i = 0; i < ind.size(); i++){
+		int kept = std::count(support[i].begin(), support[i].end(), true);
+		all_bits += support[i].size();
+		kept_bits += kept;
+		if (kept == 0){
+			continue;
+		}
+		new_ind.push_back(ind[i]);
+		if (kept < (int)support[i].size()){
+			support_bits[ind[i]] = support[i];
+		}
+	}
+	ind = new_ind;
+	std::cout<<"Independent support: "<<kept_bits<<" / "<<all_bits<<" bits, "<<ind.size()<<" variables"<<std::endl;
+}
+
+void MEGASampler::compute_free_bits(){
+	std::vector<std::vector<bool>> used = used_bits(simpl_formula, variables);
+	int num_free = 0;
+	for (size_t i = 0; i < variables.size(); i++){
+		std::vector<bool> unused(used[i].size());
+		for (size_t j = 0; j < used[i].size(); j++){
+			unused[j] = !used[i][j];
+		}
+		int count = std::count(unused.begin(), unused.end(), true);
+		if (count > 0){
+			free_bits[variables[i]] = unused;
+			num_free += count;
+		}
+	}
+	std::vector<z3::func_decl> new_ind;
+	for (z3::func_decl & v : ind){
+		auto it = free_bits.find(v);
+		if (it == free_bits.end()){
+			new_ind.push_back(v);
+		} else if (std::count(it->second.begin(), it->second.end(), false) > 0){ // partially free bit-vector
+			auto sb = support_bits.find(v);
+			std::vector<bool> bits = sb == support_bits.end() ? std::vector<bool>(it->second.size(), true) : sb->second;
+			for (size_t j = 0; j < bits.size(); j++){
+				bits[j] = bits[j] && !it->second[j];
+			}
+			support_bits[v] = bits;
+			new_ind.push_back(v);
+		}
+	}
+	ind = new_ind;
+	std::cout<<"Unconstrained bits: "<<num_free<<std::endl;
+}
+
+void MEGASampler::do_epoch(const z3::model & model){
+	if (strategy == STRAT_POLYTOPE){
+		polytope_epoch(model);
+	} else if (strategy == STRAT_GF2){
+		gf2_epoch(model);
+	} else if (local_search_steps == 0 && !flip_phase){
+		Sampler::do_epoch(model);
+	}
+	if (flip_phase){
+		flip_epoch(model);
+	}
+	if (local_search_steps > 0){
+		local_search(model);
+	}
+}
+
+void MEGASampler::set_local_search_steps(int steps){
+	local_search_steps = steps;
+}
+
+void MEGASampler::set_flips(bool enabled, bool batched){
+	flip_phase = enabled;
+	batch_flips = batched;
+}
+
+void MEGASampler::flip_epoch(const z3::model & model){
+	// one constraint per support bit: the bit (its term) keeps its value in model
+	std::vector<z3::expr> terms;
+	std::vector<z3::expr> keep;
+	for (z3::func_decl & v : ind){
+		if (v.arity() > 0 || !(v.range().is_bool() || v.range().is_bv())){
+			continue;
+		}
+		z3::expr val = model.eval(v(), true);
+		if (val.is_bool()){
+			terms.push_back(v());
+			keep.push_back(v() == val);
+			continue;
+		}
+		auto sb = support_bits.find(v);
+		for (unsigned j = 0; j < v.range().bv_size(); j++){
+			if (sb == support_bits.end() || sb->second[j]){
+				terms.push_back(v().extract(j, j));
+				keep.push_back(terms.back() == val.extract(j, j).simplify());
+			}
+		}
+	}
+	std::vector<int> order = flip_bandit.order(terms);
+	std::deque<int> pending(order.begin(), order.end());
+	int queries = 0;
+	int sat = 0;
+	int fixed = 0;
+	int before = unique_valid_samples;
+	while (!pending.empty() && !is_epoch_over()){
+		int k = batch_flips ? std::min((int)pending.size(), (int)flip_batch) : 1;
+		std::vector<int> group(pending.begin(), pending.begin() + k);
+		pending.erase(pending.begin(), pending.begin() + k);
+		z3::expr_vector differ(c);
+		for (int i : group){
+			differ.push_back(!keep[i]);
+		}
+		solver.push();
+		solver.add(z3::mk_or(differ));
+		solver.set(timeout_params(TIMER_FLIP, FLIP_MAX_TIMEOUT_MS));
+		z3::check_result result;
+		solver_calls++;
+		++queries;
+		uint64_t query_start = monotonic_ns();
+		{
+			ScopedTimer timer(timers, TIMER_FLIP);
+			result = solver.check();
+			solver_stats.add("flip", solver.statistics(), true);
+		}
+		double seconds = (monotonic_ns() - query_start) / 1.0e9;
+		if (result == z3::sat){
+			++sat;
+			z3::model m = solver.get_model();
+			int old_samples = unique_valid_samples;
+			check_and_output_sample(m);
+			// the new samples are credited to the bits of the group the model flipped, the time to all of them
+			std::vector<int> flipped;
+			for (int i : group){
+				if (m.eval(keep[i], true).is_false()){
+					flipped.push_back(i);
+				}
+			}
+			for (int i : group){
+				bool hit = std::find(flipped.begin(), flipped.end(), i) != flipped.end();
+				flip_bandit.record(terms[i], hit ? (double)(unique_valid_samples - old_samples) / flipped.size() : 0.0, seconds / k);
+			}
+			if (batch_flips){
+				flip_batch = std::max(1.0, flip_batch / 2);
+				// the bits the model flipped are settled, the others of the group are tried again first
+				std::deque<int> unsettled;
+				for (int i : group){
+					if (!m.eval(keep[i], true).is_false()){
+						unsettled.push_back(i);
+					}
+				}
+				for (int i : pending){
+					if (!m.eval(keep[i], true).is_false()){
+						unsettled.push_back(i);
+					}
+				}
+				pending.swap(unsettled);
+			}
+		} else {
+			for (int i : group){
+				flip_bandit.record(terms[i], 0.0, seconds / k);
+			}
+		}
+		if (result == z3::unsat){
+			fixed += k;
+			if (batch_flips){
+				flip_batch = std::min((double)MAX_FLIP_BATCH, flip_batch * 2);
+			}
+		}
+		solver.pop();
+	}
+	std::cout<<"Flips: "<<queries<<" queries, "<<sat<<" sat, "<<fixed<<" fixed bits, "<<unique_valid_samples - before<<" new samples";
+	if (batch_flips){
+		std::cout<<", group size "<<(int)flip_batch;
+	}
+	std::cout<<std::endl;
+}
+
+/*
+ * Adds the top-level conjuncts of e to conjuncts.
+ */
+static void flatten_and(const z3::expr & e, std::vector<z3::expr> & conjuncts){
+	if (e.is_app() && e.decl().decl_kind() == Z3_OP_AND){
+		for (unsigned i = 0; i < e.num_args(); i++){
+			flatten_and(e.arg(i), conjuncts);
+		}
+	} else {
+		conjuncts.push_back(e);
+	}
+}
+
+/*
+ * Adds to found the indices (in index) of the constants that occur in e.
+ */
+static void collect_vars(const z3::expr & e, const std::unordered_map<Z3_func_decl, int> & index, std::unordered_set<Z3_ast> & visited, std::vector<int> & found){
+	if (!visited.insert(e).second || !e.is_app()){
+		return;
+	}
+	if (e.num_args() == 0){
+		auto it = index.find(e.decl());
+		if (it != index.end()){
+			found.push_back(it->second);
+		}
+		return;
+	}
+	for (unsigned i = 0; i < e.num_args(); i++){
+		collect_vars(e.arg(i), index, visited, found);
+	}
+}
+
+void MEGASampler::local_search(const z3::model & model){
+	std::unordered_set<Z3_func_decl> defined, independent;
+	for (auto & def : definitions){
+		defined.insert(def.first);
+	}
+	for (z3::func_decl & v : ind){
+		independent.insert(v);
+	}
+	// every bit that is neither defined nor free is searched, so that the bits that depend on the support
+	// (found by Padoa's method, without a definition) are repaired together with it
+	std::vector<z3::func_decl> vars;
+	std::vector<int> sizes; // 0 for Bools
+	std::vector<std::vector<uint64_t>> words;
+	std::vector<std::vector<int>> search_bits; // bits that may be flipped to repair a violated conjunct
+	std::vector<std::pair<int, int>> support; // (variable, bit) in the independent support, flipped to move on
+	std::unordered_map<Z3_func_decl, int> index;
+	for (z3::func_decl & v : variables){
+		if (v.arity() > 0 || !(v.range().is_bool() || v.range().is_bv()) || defined.count(v)){
+			continue;
+		}
+		int size = v.range().is_bv() ? v.range().bv_size() : 0;
+		auto fb = free_bits.find(v);
+		auto sb = support_bits.find(v);
+		std::vector<int> bits;
+		for (int j = 0; j < std::max(size, 1); j++){
+			if (fb != free_bits.end() && fb->second[j]){
+				continue;
+			}
+			bits.push_back(j);
+			if (independent.count(v) && (sb == support_bits.end() || sb->second[j])){
+				support.push_back(std::make_pair((int)vars.size(), j));
+			}
+		}
+		if (bits.empty()){
+			continue;
+		}
+		z3::expr val = model.eval(v(), true);
+		index[v] = vars.size();
+		vars.push_back(v);
+		search_bits.push_back(bits);
+		sizes.push_back(size);
+		if (size == 0){
+			words.push_back({val.bool_value() == Z3_L_TRUE ? 1ull : 0ull});
+			continue;
+		}
+		std::string hex = bv_string(val, c);
+		std::vector<uint64_t> w((size + 63) / 64, 0);
+		for (size_t d = 0; d < hex.size(); d++){ // least significant digit last
+			char digit = hex[hex.size() - 1 - d];
+			uint64_t h = digit <= '9' ? digit - '0' : 10 + digit - 'a';
+			w[d / 16] |= h << (4 * (d % 16));
+		}
+		words.push_back(w);
+	}
+	if (support.empty()){
+		return;
+	}
+	// defined variables get indices after the searched ones, so that their conjuncts are known as well
+	for (size_t d = 0; d < definitions.size(); d++){
+		index[definitions[d].first] = vars.size() + d;
+	}
+	std::vector<z3::expr> conjuncts;
+	flatten_and(simpl_formula, conjuncts);
+	std::vector<std::vector<int>> conjunct_vars(conjuncts.size()); // searched variables only
+	std::vector<std::vector<int>> var_conjuncts(vars.size() + definitions.size());
+	for (size_t k = 0; k < conjuncts.size(); k++){
+		std::unordered_set<Z3_ast> visited;
+		std::vector<int> found;
+		collect_vars(conjuncts[k], index, visited, found);
+		for (int i : found){
+			var_conjuncts[i].push_back(k);
+			if (i < (int)vars.size()){
+				conjunct_vars[k].push_back(i);
+			}
+		}
+	}
+	auto value = [&](int i){ return sizes[i] ? bv_from_words(words[i], sizes[i]) : c.bool_val(words[i][0] != 0); };
+	std::vector<z3::expr> values;
+	for (size_t i = 0; i < vars.size(); i++){
+		values.push_back(value(i));
+	}
+	z3::model current = model_with_values(model, vars, values);
+	std::vector<bool> holds(conjuncts.size()); // cached value of each conjunct under current
+	int num_violated = 0;
+	for (size_t k = 0; k < conjuncts.size(); k++){
+		holds[k] = current.eval(conjuncts[k], true).bool_value() == Z3_L_TRUE;
+		num_violated += !holds[k];
+	}
+	std::vector<int> stamp(conjuncts.size(), 0);
+	int flips = 0;
+	// flips a bit and returns the conjuncts whose value may have changed:
+	// those of the flipped variable and of the defined variables whose value changed
+	auto flip = [&](int i, int bit){
+		words[i][bit / 64] ^= 1ull << (bit % 64);
+		z3::expr val = value(i);
+		current.add_const_interp(vars[i], val); // replaces the previous value
+		std::vector<int> affected;
+		++flips;
+		auto mark = [&](int v){
+			for (int k : var_conjuncts[v]){
+				if (stamp[k] != flips){
+					stamp[k] = flips;
+					affected.push_back(k);
+				}
+			}
+		};
+		mark(i);
+		for (size_t d = 0; d < definitions.size(); d++){
+			z3::expr def_val = current.eval(definitions[d].second, true);
+			if (!z3::eq(def_val, current.eval(definitions[d].first(), true))){
+				current.add_const_interp(definitions[d].first, def_val);
+				mark(vars.size() + d);
+			}
+		}
+		return affected;
+	};
+	// re-evaluates the affected conjuncts, and updates the cache if commit is set; returns the new number of violated conjuncts
+	auto update = [&](const std::vector<int> & affected, bool commit){
+		int count = num_violated;
+		for (int k : affected){
+			bool h = current.eval(conjuncts[k], true).bool_value() == Z3_L_TRUE;
+			count += (int)holds[k] - (int)h;
+			if (commit){
+				holds[k] = h;
+			}
+		}
+		if (commit){
+			num_violated = count;
+		}
+		return count;
+	};
+	auto random_bit = [&](int i){ return search_bits[i][rng.next_below(search_bits[i].size())]; };
+	int steps = 0;
+	int visited = 0;
+	int before = unique_valid_samples;
+	for (; steps < local_search_steps && !is_epoch_over(); steps++){
+		if (num_violated == 0){
+			++visited;
+			check_and_output_sample(current);
+			const std::pair<int, int> & b = support[rng.next_below(support.size())];
+			update(flip(b.first, b.second), true);
+			continue;
+		}
+		std::vector<int> broken;
+		for (size_t k = 0; k < conjuncts.size(); k++){
+			if (!holds[k]){
+				broken.push_back(k);
+			}
+		}
+		const std::vector<int> & candidates = conjunct_vars[broken[rng.next_below(broken.size())]];
+		auto pick = [&]{ return candidates.empty() ? (int)rng.next_below(vars.size()) : candidates[rng.next_below(candidates.size())]; };
+		if (rng.next_double() < LS_NOISE){
+			int i = pick();
+			update(flip(i, random_bit(i)), true);
+			continue;
+		}
+		int best_var = -1, best_bit = 0, best_count = 0;
+		for (int t = 0; t < LS_CANDIDATES; t++){
+			int i = pick();
+			int bit = random_bit(i);
+			int count = update(flip(i, bit), false);
+			flip(i, bit);
+			if (best_var < 0 || count < best_count){
+				best_var = i;
+				best_bit = bit;
+				best_count = count;
+			}
+		}
+		update(flip(best_var, best_bit), true);
+	}
+	std::cout<<"Local search: "<<steps<<" steps, "<<visited<<" satisfying assignments visited, "<<unique_valid_samples - before<<" new samples"<<std::endl;
+}
+
+void MEGASampler::run_epoch(){
+	try{
+		const z3::model & m = start_epoch();
+		if (should_stop())
+			return;
+		ScopedTimer timer(timers, TIMER_DO_EPOCH);
+		do_epoch(m);
+	} catch (z3::exception& except) {
+		// "canceled" when the watchdog interrupts Z3 at a deadline, which only ends the epoch
+		if (!is_epoch_over()) {
+			std::cout << "Termination due to: " << except << "\n";
+			stop_requested = true;
+		}
+	}
+	end_epoch();
+	if (!auto_strategy || probing){
+		return;
+	}
+	double now = get_elapsed_time();
+	if (now - window_start < 2 * probe_fraction * max_time){
+		return;
+	}
+	double rate = (unique_valid_samples - window_samples) / (now - window_start);
+	if (rate < tuned_rate / 2){
+		std::cout<<"Auto: throughput of "<<strategy_name(strategy)<<" dropped to "<<rate<<" samples/s (from "<<tuned_rate<<"), probing again"<<std::endl;
+		tune_strategy();
+	} else {
+		window_start = now;
+		window_samples = unique_valid_samples;
+	}
+}
+
+void MEGASampler::set_auto_strategy(double fraction){
+	auto_strategy = true;
+	probe_fraction = fraction;
+}
+
+std::vector<int> MEGASampler::candidate_strategies(){
+	std::vector<int> candidates = {STRAT_SMTBIT, STRAT_SMTBV, STRAT_RANDPHASE};
+	if (num_ints > 0){
+		candidates.push_back(STRAT_POLYTOPE);
+	}
+	if (gf2.num_equations() > 0){
+		candidates.push_back(STRAT_GF2);
+	}
+	return candidates;
+}
+
+void MEGASampler::use_strategy(int s){
+	strategy = s;
+	random_soft_bit = s == STRAT_SMTBIT;
+}
+
+void MEGASampler::tune_strategy(){
+	probing = true;
+	std::vector<int> candidates = candidate_strategies();
+	double budget = probe_fraction * max_time / candidates.size();
+	int best = strategy;
+	double best_rate = -1.0;
+	for (int s : candidates){
+		if (should_stop()){
+			break;
+		}
+		use_strategy(s);
+		double start = get_elapsed_time();
+		int start_samples = unique_valid_samples;
+		int probe_epochs = 0;
+		do { // at least one epoch, even if it takes longer than the budget
+			run_epoch();
+			++probe_epochs;
+		} while (get_elapsed_time() - start < budget && !should_stop());
+		double elapsed = get_elapsed_time() - start;
+		double rate = elapsed > 0 ? (unique_valid_samples - start_samples) / elapsed : 0.0;
+		std::cout<<"Auto probe: "<<strategy_name(s)<<", "<<rate<<" samples/s over "<<probe_epochs<<" epochs"<<std::endl;
+		if (rate > best_rate){
+			best = s;
+			best_rate = rate;
+		}
+	}
+	use_strategy(best);
+	tuned_rate = best_rate;
+	window_start = get_elapsed_time();
+	window_samples = unique_valid_samples;
+	probing = false;
+	std::cout<<"Auto strategy: "<<strategy_name(best)<<" ("<<best_rate<<" samples/s)"<<std::endl;
+}
+
+void MEGASampler::generalize_model(const z3::expr & e, const z3::model & m, std::vector<z3::expr> & literals){
+	if (e.is_app() && e.decl().decl_kind() == Z3_OP_AND){
+		for (unsigned i = 0; i < e.num_args(); i++){
+			generalize_model(e.arg(i), m, literals);
+		}
+	} else if (e.is_app() && e.decl().decl_kind() == Z3_OP_OR){
+		for (unsigned i = 0; i < e.num_args(); i++){
+			if (m.eval(e.arg(i), true).bool_value() == Z3_L_TRUE){
+				generalize_model(e.arg(i), m, literals);
+				return;
+			}
+		}
+	} else {
+		literals.push_back(e);
+	}
+}
+
+void MEGASampler::polytope_epoch(const z3::model & model){
+	std::vector<z3::expr> literals;
+	generalize_model(simpl_formula, model, literals);
+	PolytopeWalker walker(c);
+	if (!walker.build(literals, model)){
+		std::cout<<"Epoch: no linear integer literals, keeping only original model"<<std::endl;
+		return;
+	}
+	const std::vector<z3::func_decl> & vars = walker.get_vars();
+	std::vector<long long> point;
+	int all = 0;
+	int good = 0;
+	for (int step = 0; step < max_epoch_samples && !is_epoch_over(); step++){
+		if (!walker.next_point(point, rng)){
+			continue;
+		}
+		std::vector<z3::expr> values;
+		for (long long x : point){
+			values.push_back(c.int_val((int64_t)x));
+		}
+		++all;
+		if (check_and_output_sample(model_with_values(model, vars, values))){
+			++good;
+		}
+	}
+	std::cout<<"Polytope walk over "<<vars.size()<<" variables, "<<literals.size()<<" literals. Valid: "<<good<<" / "<<all<<std::endl;
+}
+
+void MEGASampler::gf2_epoch(const z3::model & model){
+	if (!gf2.is_consistent() || gf2.get_columns().empty()){
+		std::cout<<"Epoch: no GF2 subsystem, keeping only original model"<<std::endl;
+		return;
+	}
+	const std::vector<std::pair<z3::func_decl, unsigned>> & columns = gf2.get_columns();
+	// variables touched by the affine system, with their values in model as hex strings
+	std::vector<z3::func_decl> vars;
+	std::vector<std::string> base_values;
+	std::vector<int> column_var;
+	for (const std::pair<z3::func_decl, unsigned> & col : columns){
+		size_t i = 0;
+		while (i < vars.size() && !z3::eq(vars[i], col.first)){
+			i++;
+		}
+		if (i == vars.size()){
+			vars.push_back(col.first);
+			z3::expr val = model.eval(col.first(), true);
+			base_values.push_back(val.is_bool() ? std::to_string(val.bool_value() == Z3_L_TRUE) : bv_string(val, c));
+		}
+		column_var.push_back(i);
+	}
+	int max_draws = gf2.num_free() < 30 ? std::min(max_epoch_samples, 1 << gf2.num_free()) : max_epoch_samples;
+	std::vector<bool> bits;
+	int all = 0;
+	int good = 0;
+	int repaired = 0;
+	for (int draw = 0; draw < max_draws && !is_epoch_over(); draw++){
+		gf2.sample(bits, rng);
+		std::vector<std::string> new_values = base_values;
+		for (size_t col = 0; col < columns.size(); col++){
+			std::string & s = new_values[column_var[col]];
+			if (vars[column_var[col]].range().is_bool()){
+				s = bits[col] ? "1" : "0";
+				continue;
+			}
+			unsigned bit = columns[col].second;
+			char & digit = s[s.size() - 1 - bit / 4];
+			unsigned char h = digit <= '9' ? digit - '0' : 10 + digit - 'a';
+			h = bits[col] ? (h | (1 << (bit % 4))) : (h & ~(1 << (bit % 4)));
+			digit = h <= 9 ? '0' + h : 'a' + h - 10;
+		}
+		std::vector<z3::expr> values;
+		for (size_t i = 0; i < vars.size(); i++){
+			if (vars[i].range().is_bool()){
+				values.push_back(c.bool_val(new_values[i] == "1"));
+			} else {
+				values.push_back(z3::expr(c, parse_bv(new_values[i].c_str(), vars[i].range(), c)));
+			}
+		}
+		++all;
+		if (check_and_output_sample(model_with_values(model, vars, values))){
+			++good;
+			continue;
+		}
+		// the affine part holds, let Z3 solve the non-linear part around it (other bits are free)
+		gf2_rest.push();
+		for (size_t col = 0; col < columns.size(); col++){
+			const z3::func_decl & v = vars[column_var[col]];
+			if (v.range().is_bool()){
+				gf2_rest.add(v() == c.bool_val(bits[col]));
+			} else {
+				unsigned bit = columns[col].second;
+				gf2_rest.add(v().extract(bit, bit) == c.bv_val(bits[col] ? 1 : 0, 1));
+			}
+		}
+		z3::check_result result;
+		solver_calls++;
+		gf2_rest.set(timeout_params(TIMER_GF2, GF2_MAX_TIMEOUT_MS)); // a hard repair must not stall the epoch
+		{
+			ScopedTimer timer(timers, TIMER_GF2);
+			result = gf2_rest.check();
+			solver_stats.add("gf2", gf2_rest.statistics(), true);
+		}
+		if (result == z3::sat){
+			++repaired;
+			check_and_output_sample(gf2_rest.get_model());
+		}
+		gf2_rest.pop();
+	}
+	std::cout<<"GF2 sampling: "<<good<<" / "<<all<<" valid, "<<repaired<<" repaired by solver"<<std::endl;
+}
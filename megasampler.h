@@ -2,16 +2,122 @@
 #define MEGASAMPLER_H_
 
 #include "sampler.h"
+#include "gf2.h"
+#include "bandit.h"
 
 class MEGASampler : public Sampler {
 
     z3::expr simpl_formula;
+    GF2System gf2;
+    z3::solver gf2_rest; // non-linear part of the formula, for STRAT_GF2
+
+    int local_search_steps = 0; // steps of local search around each epoch model (0 disables it)
+
+    //Flip phase (--flip)
+    bool flip_phase = false;
+    bool batch_flips = false; // one query per group of bits instead of one per bit
+    double flip_batch = 1.0; // current group size of batched flips, adapted to their sat ratio across epochs
+    FlipBandit flip_bandit; // orders the flips by their yield in the previous epochs
+
+    //Strategy tuning (--auto)
+    bool auto_strategy = false;
+    double probe_fraction = 0.05; // fraction of max_time spent probing the strategies
+    bool probing = false;
+    double tuned_rate = 0.0; // unique samples per second of the chosen strategy while probing
+    double window_start = 0.0; // throughput is compared to tuned_rate over windows starting here
+    int window_samples = 0;
 
 public:
     MEGASampler(std::string input, int max_samples, double max_time, int max_epoch_samples, double max_epoch_time, int strategy);
     void initialize_solvers();
+    /*
+     * Sampling epoch: dispatches on the strategy.
+     * STRAT_POLYTOPE walks inside the polytope of the linear literals implied by model,
+     * STRAT_GF2 samples the affine GF(2) subsystem of the formula,
+     * other strategies keep only the original model.
+     * The flip phase and the local search follow, if enabled.
+     */
+    void do_epoch(const z3::model & model);
+    /*
+     * Runs one epoch (start_epoch and do_epoch).
+     * A Z3 exception that is not due to a deadline stops sampling.
+     * With --auto, re-probes the strategies if throughput dropped.
+     */
+    void run_epoch();
+    /*
+     * Lets tune_strategy choose the strategy, probing for the given fraction of max_time.
+     * Must be called before initialize_solvers.
+     */
+    void set_auto_strategy(double fraction);
+    /*
+     * Sets how many local search steps are taken around each epoch model (see local_search).
+     */
+    void set_local_search_steps(int steps);
+    /*
+     * Enables the flip phase (see flip_epoch), with one query per bit or, if batched, per group of bits.
+     */
+    void set_flips(bool enabled, bool batched);
+    /*
+     * Runs epochs with every strategy applicable to the formula for an equal share of the probe time
+     * and switches to the one that produced the most unique samples per second. The rates are logged.
+     */
+    void tune_strategy();
 protected:
     void nnf_and_simplify_formula();
+    /*
+     * Restricts ind (and support_bits) to a bit-level independent support of simpl_formula,
+     * computed within support_time seconds.
+     */
+    void compute_support();
+    /*
+     * Fills free_bits with the bits of variables that simpl_formula never reads,
+     * and removes them from ind and support_bits so that no soft constraint targets them.
+     */
+    void compute_free_bits();
+    /*
+     * Collects the literals of simpl_formula (in NNF) that make it true under m:
+     * all children of a conjunction and one satisfied child of a disjunction.
+     */
+    void generalize_model(const z3::expr & e, const z3::model & m, std::vector<z3::expr> & literals);
+    /*
+     * Hit-and-run random walk over the integer variables, constrained by the generalized model.
+     * Each step is rounded to an integer point, checked against the formula and output if valid.
+     */
+    void polytope_epoch(const z3::model & model);
+    /*
+     * Draws random solutions of the affine GF(2) subsystem and writes their bits into model.
+     * If the result violates the non-linear constraints, they are solved by Z3 with the affine bits fixed.
+     */
+    void gf2_epoch(const z3::model & model);
+    /*
+     * Returns the strategies tune_strategy chooses from: smtbit, smtbv and randphase,
+     * polytope if the formula has integers and gf2 if it has an affine GF(2) part.
+     */
+    std::vector<int> candidate_strategies();
+    /*
+     * WalkSAT-like local search over the bits of the Bool and bit-vector variables that are neither defined nor free,
+     * starting from model. Each step picks a violated top-level conjunct of simpl_formula and flips a bit of one of its
+     * variables: a random one, or the best of a few random candidates (fewest violated conjuncts). Bits that depend on
+     * the support are thus repaired like the others. While no conjunct is violated, the assignment is output and a random
+     * support bit is flipped. The value of each conjunct is cached and re-evaluated only when one of its variables changes.
+     * Runs for local_search_steps steps or until the epoch is over (which includes its max_epoch_samples samples).
+     */
+    void local_search(const z3::model & model);
+    /*
+     * Flip phase: for each support bit of the Bool and bit-vector variables in ind, asks the solver for a model
+     * in which it differs from model, and outputs it. Bits for which there is none are fixed in this epoch.
+     * In batched mode, a query asks for a model differing in at least one bit of a group of flip_batch bits.
+     * A sat answer settles every bit its model flipped, the other bits of the group are tried again; an unsat
+     * answer fixes the whole group. The group size doubles after an unsat answer and halves after a sat one,
+     * so that about half of the queries are sat. Runs until every bit is settled or the epoch is over.
+     * Bits are tried in the order of flip_bandit, so that the most productive ones come first when the epoch
+     * ends before all of them are settled.
+     */
+    void flip_epoch(const z3::model & model);
+    /*
+     * Switches to strategy (in smtbit, every bit of the random targets is a soft constraint of its own).
+     */
+    void use_strategy(int s);
 };
 
 
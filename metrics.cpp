@@ -0,0 +1,124 @@
+/*
+ * metrics.cpp
+ *
+ *  Background export of live metrics in Prometheus text format.
+ */
+#include "metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+MetricsExporter::MetricsExporter(const std::string & target, double interval, std::function<std::string()> collect) : interval(interval), collect(collect), running(false){
+	use_socket = target.compare(0, 5, "unix:") == 0;
+	path = use_socket ? target.substr(5) : target;
+}
+
+MetricsExporter::~MetricsExporter(){
+	stop();
+}
+
+bool MetricsExporter::start(){
+	if (use_socket){
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(path.c_str());
+		if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 8) < 0){
+			std::cout << "Could not open metrics socket " << path << ": " << strerror(errno) << '\n';
+			if (listen_fd >= 0){
+				close(listen_fd);
+				listen_fd = -1;
+			}
+			return false;
+		}
+	}
+	running = true;
+	worker = std::thread(&MetricsExporter::run, this);
+	return true;
+}
+
+void MetricsExporter::stop(){
+	{
+		// under the lock, so that the notification cannot fall between the worker's check and its wait
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running.exchange(false)){
+			return;
+		}
+	}
+	wakeup.notify_all();
+	worker.join();
+	if (use_socket){
+		close(listen_fd);
+		unlink(path.c_str());
+		listen_fd = -1;
+	} else {
+		write_file();
+	}
+}
+
+void MetricsExporter::run(){
+	while (running){
+		if (use_socket){
+			serve_clients((int)(interval * 1000));
+		} else {
+			write_file();
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeup.wait_for(lock, std::chrono::duration<double>(interval), [this]{ return !running; });
+		}
+	}
+}
+
+void MetricsExporter::write_file(){
+	// write to a temporary file and rename it, so a scraper never sees a partial file
+	std::string tmp = path + ".tmp";
+	std::ofstream out(tmp);
+	out << collect();
+	out.close();
+	rename(tmp.c_str(), path.c_str());
+}
+
+void MetricsExporter::serve_clients(int timeout_ms){
+	// wake up regularly to notice stop()
+	struct pollfd pfd = { listen_fd, POLLIN, 0 };
+	if (poll(&pfd, 1, std::min(timeout_ms, 200)) <= 0){
+		return;
+	}
+	int client = accept(listen_fd, NULL, NULL);
+	if (client < 0){
+		return;
+	}
+	std::string text = collect();
+	size_t sent = 0;
+	while (sent < text.size()){
+		ssize_t n = send(client, text.c_str() + sent, text.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0){
+			break;
+		}
+		sent += n;
+	}
+	close(client);
+}
+
+long resident_memory_bytes(){
+	long pages = 0;
+	long resident = 0;
+	FILE * f = fopen("/proc/self/statm", "r");
+	if (!f){
+		return 0;
+	}
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2){
+		resident = 0;
+	}
+	fclose(f);
+	return resident * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,58 @@
+/*
+ * metrics.h
+ *
+ *  Background export of live metrics in Prometheus text format.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MetricsExporter{
+
+	std::string path;
+	bool use_socket;
+	double interval;
+	std::function<std::string()> collect;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	int listen_fd = -1;
+
+public:
+	/*
+	 * target is either a file path, rewritten every interval seconds,
+	 * or "unix:<path>", a Unix domain socket that answers every connection with the current metrics.
+	 * collect produces the metrics text; it is called from the exporter thread, so it must only read
+	 * data that is safe to access concurrently with sampling (atomics).
+	 */
+	MetricsExporter(const std::string & target, double interval, std::function<std::string()> collect);
+	~MetricsExporter();
+	/*
+	 * Starts the exporter thread. Returns false if the socket could not be created.
+	 */
+	bool start();
+	/*
+	 * Publishes the metrics one last time (file mode) and joins the exporter thread.
+	 */
+	void stop();
+
+protected:
+	void run();
+	void write_file();
+	void serve_clients(int timeout_ms);
+};
+
+/*
+ * Returns the resident set size of this process in bytes (0 if unavailable).
+ */
+long resident_memory_bytes();
+
+#endif /* METRICS_H_ */
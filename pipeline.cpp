@@ -0,0 +1,181 @@
+/*
+ * pipeline.cpp
+ *
+ *  Producer thread computing epoch models in its own Z3 context, ahead of the sampling thread.
+ */
+#include "pipeline.h"
+#include "sampler.h"
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+/*
+ * Adds the uninterpreted constants of e to decls, by name.
+ */
+static void collect_constants(const z3::expr & e, std::unordered_set<Z3_ast> & visited, std::unordered_map<std::string, z3::func_decl> & decls){
+	if (!visited.insert(e).second || !e.is_app()){
+		return;
+	}
+	if (e.num_args() == 0 && e.decl().decl_kind() == Z3_OP_UNINTERPRETED){
+		decls.insert({e.decl().name().str(), e.decl()});
+		return;
+	}
+	for (unsigned i = 0; i < e.num_args(); i++){
+		collect_constants(e.arg(i), visited, decls);
+	}
+}
+
+EpochPipeline::EpochPipeline(const std::string & input, const std::vector<std::string> & ind_names,
+		const std::unordered_map<std::string, std::vector<bool>> & support, const std::vector<std::string> & output_names,
+		bool soft_bits, Random rng, size_t capacity, unsigned timeout_ms, unsigned rlimit, const std::string & engine) :
+		opt(c), formula(c), soft_bits(soft_bits), rng(rng), capacity(capacity), watchdog(c), running(false), done(true), produced(0){
+	z3::expr parsed = c.parse_file(input.c_str());
+	formula = parsed;
+	std::unordered_map<std::string, z3::func_decl> decls;
+	std::unordered_set<Z3_ast> visited;
+	collect_constants(formula, visited, decls);
+	for (const std::string & name : ind_names){
+		auto it = decls.find(name);
+		if (it != decls.end()){
+			ind.push_back(it->second);
+		}
+	}
+	for (const auto & s : support){
+		auto it = decls.find(s.first);
+		if (it != decls.end()){
+			support_bits[it->second] = s.second;
+		}
+	}
+	for (const std::string & name : output_names){
+		outputs.push_back(decls.at(name)); // the sampler found its variables in the same formula
+	}
+	z3::params p(c);
+	if (rlimit){
+		p.set("rlimit", rlimit);
+	} else {
+		p.set("timeout", timeout_ms);
+	}
+	if (!engine.empty()){
+		p.set("maxsat_engine", c.str_symbol(engine.c_str()));
+	}
+	opt.set(p);
+	opt.add(formula);
+}
+
+EpochPipeline::~EpochPipeline(){
+	stop();
+}
+
+void EpochPipeline::start(uint64_t deadline){
+	running = true;
+	done = false;
+	watchdog.start(deadline);
+	worker = std::thread(&EpochPipeline::run, this);
+}
+
+void EpochPipeline::stop(){
+	{
+		// under the lock, so that the notification cannot fall between the producer's check and its wait
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running.exchange(false)){
+			return;
+		}
+	}
+	not_full.notify_all();
+	// an interrupt is lost if no check is running, so it is repeated until the producer is done
+	while (!done){
+		c.interrupt();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	worker.join();
+	watchdog.stop();
+}
+
+std::vector<SolverStatistics::Counters> EpochPipeline::take_stats(){
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<SolverStatistics::Counters> taken;
+	taken.swap(stats);
+	return taken;
+}
+
+bool EpochPipeline::pop(std::vector<std::string> & values, const std::function<bool()> & give_up){
+	std::unique_lock<std::mutex> lock(mutex);
+	while (queue.empty()){
+		if (give_up() || done){
+			return false;
+		}
+		not_empty.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	values = std::move(queue.front());
+	queue.pop_front();
+	not_full.notify_one();
+	return true;
+}
+
+bool EpochPipeline::get_model(z3::check_result result, z3::model & m){
+	if (result == z3::unsat){
+		return false;
+	}
+	try {
+		m = opt.get_model();
+	} catch (z3::exception except) {
+		return false;
+	}
+	if (result == z3::sat){
+		return true;
+	}
+	return m.size() > 0 && m.eval(formula, true).is_true();
+}
+
+void EpochPipeline::run(){
+	while (running && !watchdog.is_expired()){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			not_full.wait(lock, [this]{ return !running || queue.size() < capacity; });
+		}
+		if (!running){
+			break;
+		}
+		opt.push();
+		add_random_targets(opt, rng, ind, support_bits, soft_bits);
+		z3::check_result result = z3::unknown;
+		try {
+			result = opt.check();
+		} catch (z3::exception except) {
+			// canceled by stop() or at the deadline
+		}
+		SolverStatistics::Counters counters = SolverStatistics::counters_of(opt.statistics(), context_stats);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.push_back(counters);
+		}
+		z3::model m(c);
+		bool found = running && !watchdog.is_expired() && get_model(result, m);
+		std::vector<std::string> values;
+		if (found){
+			for (const z3::func_decl & v : outputs){
+				z3::expr val = m.eval(v(), true);
+				if (val.is_bool()){
+					values.push_back(val.bool_value() == Z3_L_TRUE ? "1" : "0");
+				} else if (val.is_bv()){
+					values.push_back(bv_string(val, c));
+				} else {
+					values.push_back(Z3_get_numeral_string(c, val));
+				}
+			}
+		}
+		opt.pop();
+		if (result == z3::unsat){
+			std::cout << "Pipeline: formula is unsat" << std::endl;
+			break;
+		}
+		if (found){
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(values));
+			produced++;
+			not_empty.notify_one();
+		}
+	}
+	done = true;
+	not_empty.notify_all();
+}
@@ -0,0 +1,88 @@
+/*
+ * pipeline.h
+ *
+ *  Producer thread computing epoch models in its own Z3 context, ahead of the sampling thread.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <z3++.h>
+#include "random.h"
+#include "solver_stats.h"
+#include "watchdog.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class EpochPipeline{
+
+	z3::context c;
+	z3::optimize opt;
+	z3::expr formula;
+	std::vector<z3::func_decl> ind; // random targets, as in Sampler
+	std::unordered_map<Z3_func_decl, std::vector<bool>> support_bits;
+	std::vector<z3::func_decl> outputs; // variables whose values are passed to the sampling thread
+	bool soft_bits;
+	Random rng;
+	size_t capacity;
+	Watchdog watchdog; // interrupts c at the global deadline
+	SolverStatistics::Counters context_stats; // context counters at the last check (see SolverStatistics::counters_of)
+	std::vector<SolverStatistics::Counters> stats; // statistics of the checks not yet taken by take_stats
+
+	std::deque<std::vector<std::string>> queue;
+	std::mutex mutex;
+	std::condition_variable not_full;
+	std::condition_variable not_empty;
+	std::atomic<bool> running;
+	std::atomic<bool> done;
+	std::atomic<int> produced;
+	std::thread worker;
+
+public:
+	/*
+	 * Parses input again in the pipeline's own context. Variables are given by name:
+	 * ind and support (bits of the partially supported bit-vectors) as in Sampler,
+	 * outputs are the variables whose values are passed on (Bools, bit-vectors and Ints only).
+	 * Queries are limited by timeout_ms, or by rlimit if it is not 0; engine is the MaxSAT engine (empty for the default).
+	 */
+	EpochPipeline(const std::string & input, const std::vector<std::string> & ind_names,
+			const std::unordered_map<std::string, std::vector<bool>> & support, const std::vector<std::string> & output_names,
+			bool soft_bits, Random rng, size_t capacity, unsigned timeout_ms, unsigned rlimit, const std::string & engine);
+	~EpochPipeline();
+	/*
+	 * Starts the producer. Its checks are interrupted, and it stops, at deadline (in monotonic_ns time).
+	 */
+	void start(uint64_t deadline);
+	/*
+	 * Stops the producer, interrupting its solver if needed.
+	 */
+	void stop();
+	/*
+	 * Returns the statistics of the producer's checks since the last call (one entry per check).
+	 */
+	std::vector<SolverStatistics::Counters> take_stats();
+	/*
+	 * Waits for the next epoch model and stores the values of the output variables in values
+	 * (bv_string for bit-vectors, "0"/"1" for Bools, decimal for Ints).
+	 * Returns false, without a model, as soon as give_up returns true (checked every 10ms).
+	 */
+	bool pop(std::vector<std::string> & values, const std::function<bool()> & give_up);
+	int get_produced() const { return produced.load(std::memory_order_relaxed); }
+
+protected:
+	void run();
+	/*
+	 * Returns the model of opt after a check, or the best one found before a timeout if it satisfies the formula.
+	 * Returns false if there is none.
+	 */
+	bool get_model(z3::check_result result, z3::model & m);
+};
+
+#endif /* PIPELINE_H_ */
@@ -0,0 +1,299 @@
+/*
+ * polytope.cpp
+ *
+ *  Random walk inside the polytope described by a conjunction of linear integer literals.
+ */
+#include "polytope.h"
+#include <cmath>
+#include <cstdlib>
+
+PolytopeWalker::PolytopeWalker(z3::context & c, double max_step) : c(c), max_step(max_step){
+}
+
+bool PolytopeWalker::build(const std::vector<z3::expr> & literals, const z3::model & m){
+	vars.clear();
+	ineq_coeffs.clear();
+	ineq_bounds.clear();
+	eq_basis.clear();
+	point.clear();
+	std::vector<std::vector<double>> eq_rows;
+	for (const z3::expr & lit : literals){
+		size_t num_ineqs = ineq_coeffs.size();
+		if (!add_literal(lit)){
+			continue;
+		}
+		// an equality is added as a pair of inequalities, keep its row for the direction projection
+		if (ineq_coeffs.size() == num_ineqs + 2 && lit.decl().decl_kind() == Z3_OP_EQ){
+			eq_rows.push_back(ineq_coeffs[num_ineqs]);
+		}
+	}
+	if (vars.empty()){
+		return false;
+	}
+	for (std::vector<double> & row : ineq_coeffs){
+		row.resize(vars.size(), 0.0);
+	}
+	// Gram-Schmidt on the equality rows, so that directions can be projected onto their null space
+	for (std::vector<double> & row : eq_rows){
+		row.resize(vars.size(), 0.0);
+		for (const std::vector<double> & q : eq_basis){
+			double dot = 0.0;
+			for (size_t i = 0; i < vars.size(); i++){
+				dot += row[i] * q[i];
+			}
+			for (size_t i = 0; i < vars.size(); i++){
+				row[i] -= dot * q[i];
+			}
+		}
+		double norm = 0.0;
+		for (double a : row){
+			norm += a * a;
+		}
+		norm = sqrt(norm);
+		if (norm < 1e-9){
+			continue; // linearly dependent on previous equalities
+		}
+		for (double & a : row){
+			a /= norm;
+		}
+		eq_basis.push_back(row);
+	}
+	for (z3::func_decl & v : vars){
+		z3::expr val = m.eval(v(), true);
+		int64_t n;
+		if (!val.is_numeral_i64(n)){
+			return false;
+		}
+		point.push_back((double)n);
+	}
+	return true;
+}
+
+bool PolytopeWalker::add_literal(const z3::expr & lit){
+	if (!lit.is_app() || lit.num_args() == 0){
+		return false;
+	}
+	Z3_decl_kind kind = lit.decl().decl_kind();
+	if (kind == Z3_OP_NOT){
+		z3::expr atom = lit.arg(0);
+		if (!atom.is_app() || atom.num_args() != 2){
+			return false;
+		}
+		switch (atom.decl().decl_kind()){
+			case Z3_OP_LE:
+				return add_row(atom.arg(0), atom.arg(1), Z3_OP_GT);
+			case Z3_OP_LT:
+				return add_row(atom.arg(0), atom.arg(1), Z3_OP_GE);
+			case Z3_OP_GE:
+				return add_row(atom.arg(0), atom.arg(1), Z3_OP_LT);
+			case Z3_OP_GT:
+				return add_row(atom.arg(0), atom.arg(1), Z3_OP_LE);
+			default:
+				return false; // disequalities are not convex
+		}
+	}
+	if (lit.num_args() != 2){
+		return false;
+	}
+	return add_row(lit.arg(0), lit.arg(1), kind);
+}
+
+bool PolytopeWalker::add_row(const z3::expr & lhs, const z3::expr & rhs, Z3_decl_kind kind){
+	if (!lhs.is_int() || !rhs.is_int()){
+		return false;
+	}
+	if (kind != Z3_OP_LE && kind != Z3_OP_LT && kind != Z3_OP_GE && kind != Z3_OP_GT && kind != Z3_OP_EQ){
+		return false;
+	}
+	std::vector<double> coeffs(vars.size(), 0.0);
+	double constant = 0.0;
+	size_t num_vars = vars.size();
+	// lhs - rhs + constant (op) 0
+	if (!linear_terms(lhs, 1.0, coeffs, constant) || !linear_terms(rhs, -1.0, coeffs, constant)){
+		vars.resize(num_vars, z3::func_decl(c)); // forget variables introduced by the rejected literal
+		return false;
+	}
+	coeffs.resize(vars.size(), 0.0);
+	std::vector<double> negated(coeffs.size());
+	for (size_t i = 0; i < coeffs.size(); i++){
+		negated[i] = -coeffs[i];
+	}
+	// all coefficients are integers, so strict inequalities are tightened by one
+	switch (kind){
+		case Z3_OP_LE:
+			ineq_coeffs.push_back(coeffs);
+			ineq_bounds.push_back(-constant);
+			break;
+		case Z3_OP_LT:
+			ineq_coeffs.push_back(coeffs);
+			ineq_bounds.push_back(-constant - 1.0);
+			break;
+		case Z3_OP_GE:
+			ineq_coeffs.push_back(negated);
+			ineq_bounds.push_back(constant);
+			break;
+		case Z3_OP_GT:
+			ineq_coeffs.push_back(negated);
+			ineq_bounds.push_back(constant - 1.0);
+			break;
+		default: // Z3_OP_EQ
+			ineq_coeffs.push_back(coeffs);
+			ineq_bounds.push_back(-constant);
+			ineq_coeffs.push_back(negated);
+			ineq_bounds.push_back(constant);
+			break;
+	}
+	return true;
+}
+
+bool PolytopeWalker::linear_terms(const z3::expr & e, double factor, std::vector<double> & coeffs, double & constant){
+	int64_t n;
+	if (e.is_numeral_i64(n)){
+		constant += factor * n;
+		return true;
+	}
+	if (!e.is_app()){
+		return false;
+	}
+	z3::func_decl fd = e.decl();
+	if (e.is_const() && fd.decl_kind() == Z3_OP_UNINTERPRETED){
+		int idx = var_index(fd);
+		if ((size_t)idx >= coeffs.size()){
+			coeffs.resize(idx + 1, 0.0);
+		}
+		coeffs[idx] += factor;
+		return true;
+	}
+	switch (fd.decl_kind()){
+		case Z3_OP_ADD:
+			for (unsigned i = 0; i < e.num_args(); i++){
+				if (!linear_terms(e.arg(i), factor, coeffs, constant)){
+					return false;
+				}
+			}
+			return true;
+		case Z3_OP_SUB:
+			for (unsigned i = 0; i < e.num_args(); i++){
+				if (!linear_terms(e.arg(i), i == 0 ? factor : -factor, coeffs, constant)){
+					return false;
+				}
+			}
+			return true;
+		case Z3_OP_UMINUS:
+			return linear_terms(e.arg(0), -factor, coeffs, constant);
+		case Z3_OP_MUL:
+		{
+			// linear only if at most one factor is not a numeral
+			double scale = factor;
+			int term = -1;
+			for (unsigned i = 0; i < e.num_args(); i++){
+				if (e.arg(i).is_numeral_i64(n)){
+					scale *= n;
+				} else if (term == -1){
+					term = i;
+				} else {
+					return false;
+				}
+			}
+			if (term == -1){
+				constant += scale;
+				return true;
+			}
+			return linear_terms(e.arg(term), scale, coeffs, constant);
+		}
+		default:
+			return false;
+	}
+}
+
+int PolytopeWalker::var_index(const z3::func_decl & v){
+	for (size_t i = 0; i < vars.size(); i++){
+		if (z3::eq(vars[i], v)){
+			return i;
+		}
+	}
+	vars.push_back(v);
+	return vars.size() - 1;
+}
+
+void PolytopeWalker::random_direction(std::vector<double> & d, Random & rng){
+	d.resize(vars.size());
+	for (size_t i = 0; i < vars.size(); i++){
+		// Box-Muller transform, gives an isotropic direction after normalization
+		double u1 = 1.0 - rng.next_double(); // in (0, 1]
+		double u2 = rng.next_double();
+		d[i] = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+	}
+	for (const std::vector<double> & q : eq_basis){
+		double dot = 0.0;
+		for (size_t i = 0; i < vars.size(); i++){
+			dot += d[i] * q[i];
+		}
+		for (size_t i = 0; i < vars.size(); i++){
+			d[i] -= dot * q[i];
+		}
+	}
+	double norm = 0.0;
+	for (double a : d){
+		norm += a * a;
+	}
+	norm = sqrt(norm);
+	for (double & a : d){
+		a = norm < 1e-9 ? 0.0 : a / norm;
+	}
+}
+
+bool PolytopeWalker::next_point(std::vector<long long> & values, Random & rng){
+	std::vector<double> d;
+	random_direction(d, rng);
+	double t_min = -max_step;
+	double t_max = max_step;
+	for (size_t r = 0; r < ineq_coeffs.size(); r++){
+		double ad = 0.0;
+		double ay = 0.0;
+		for (size_t i = 0; i < vars.size(); i++){
+			ad += ineq_coeffs[r][i] * d[i];
+			ay += ineq_coeffs[r][i] * point[i];
+		}
+		double slack = ineq_bounds[r] - ay;
+		if (ad > 1e-12){
+			t_max = std::min(t_max, slack / ad);
+		} else if (ad < -1e-12){
+			t_min = std::max(t_min, slack / ad);
+		}
+	}
+	if (t_min > t_max){
+		return false;
+	}
+	double t = t_min + (t_max - t_min) * rng.next_double();
+	for (size_t i = 0; i < vars.size(); i++){
+		point[i] += t * d[i];
+	}
+	// nearest integer point first, then a few randomized roundings
+	values.resize(vars.size());
+	for (size_t i = 0; i < vars.size(); i++){
+		values[i] = llround(point[i]);
+	}
+	for (int attempt = 0; attempt < 4; attempt++){
+		if (satisfies_rows(values)){
+			return true;
+		}
+		for (size_t i = 0; i < vars.size(); i++){
+			values[i] = (long long)(rng.next_bool() ? floor(point[i]) : ceil(point[i]));
+		}
+	}
+	return satisfies_rows(values);
+}
+
+bool PolytopeWalker::satisfies_rows(const std::vector<long long> & x){
+	for (size_t r = 0; r < ineq_coeffs.size(); r++){
+		double ax = 0.0;
+		for (size_t i = 0; i < vars.size(); i++){
+			ax += ineq_coeffs[r][i] * x[i];
+		}
+		if (ax > ineq_bounds[r] + 1e-9){
+			return false;
+		}
+	}
+	return true;
+}
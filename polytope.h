@@ -0,0 +1,54 @@
+/*
+ * polytope.h
+ *
+ *  Random walk inside the polytope described by a conjunction of linear integer literals.
+ */
+
+#ifndef POLYTOPE_H_
+#define POLYTOPE_H_
+
+#include <z3++.h>
+#include "random.h"
+#include <vector>
+
+class PolytopeWalker{
+
+	z3::context & c;
+	std::vector<z3::func_decl> vars; // integer variables spanning the polytope
+	std::vector<std::vector<double>> ineq_coeffs; // rows of A in A*x <= b
+	std::vector<double> ineq_bounds; // b in A*x <= b
+	std::vector<std::vector<double>> eq_basis; // orthonormal basis of the equality rows (directions are kept orthogonal to it)
+	std::vector<double> point; // current (real valued) point of the walk
+	double max_step;
+
+public:
+	PolytopeWalker(z3::context & c, double max_step = 1000.0);
+	/*
+	 * Builds the polytope from the given literals (which should hold under m).
+	 * Literals that are not linear integer (in)equalities are ignored,
+	 * so a point produced by the walk must still be checked against the formula.
+	 * The walk starts from the values m assigns to the integer variables.
+	 * Returns false if no integer variable is constrained by the literals.
+	 */
+	bool build(const std::vector<z3::expr> & literals, const z3::model & m);
+	/*
+	 * Integer variables the walk assigns (in the order used by next_point).
+	 */
+	const std::vector<z3::func_decl> & get_vars() const { return vars; }
+	/*
+	 * Makes one hit-and-run step from the current point and rounds the result.
+	 * Returns false if the rounded point violates one of the linear literals,
+	 * otherwise the integer values are stored in values (ordered as get_vars()).
+	 */
+	bool next_point(std::vector<long long> & values, Random & rng);
+
+protected:
+	bool add_literal(const z3::expr & lit);
+	bool add_row(const z3::expr & lhs, const z3::expr & rhs, Z3_decl_kind kind);
+	bool linear_terms(const z3::expr & e, double factor, std::vector<double> & coeffs, double & constant);
+	int var_index(const z3::func_decl & v);
+	void random_direction(std::vector<double> & d, Random & rng);
+	bool satisfies_rows(const std::vector<long long> & x);
+};
+
+#endif /* POLYTOPE_H_ */
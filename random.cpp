@@ -0,0 +1,37 @@
+/*
+ * random.cpp
+ *
+ *  Fast splittable pseudo-random number generator (xoshiro256**, seeded with SplitMix64).
+ */
+#include "random.h"
+
+void Random::set_seed(uint64_t seed){
+	// SplitMix64 spreads any seed (even 0) over the whole state
+	for (int i = 0; i < 4; i++){
+		seed += 0x9e3779b97f4a7c15ull;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		s[i] = z ^ (z >> 31);
+	}
+}
+
+Random Random::split(){
+	Random child = *this;
+	static const uint64_t jump[] = {0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull};
+	uint64_t t[4] = {0, 0, 0, 0};
+	for (int i = 0; i < 4; i++){
+		for (int b = 0; b < 64; b++){
+			if (jump[i] & ((uint64_t)1 << b)){
+				for (int k = 0; k < 4; k++){
+					t[k] ^= s[k];
+				}
+			}
+			next();
+		}
+	}
+	for (int k = 0; k < 4; k++){
+		s[k] = t[k];
+	}
+	return child;
+}
@@ -0,0 +1,54 @@
+/*
+ * random.h
+ *
+ *  Fast splittable pseudo-random number generator (xoshiro256**, seeded with SplitMix64).
+ */
+
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <stdint.h>
+
+class Random{
+
+	uint64_t s[4];
+
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+	explicit Random(uint64_t seed = 0) { set_seed(seed); }
+	/*
+	 * Restarts the generator. The same seed always gives the same sequence.
+	 */
+	void set_seed(uint64_t seed);
+	/*
+	 * Returns 64 uniformly random bits.
+	 */
+	uint64_t next(){
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+	bool next_bool() { return next() >> 63; }
+	/*
+	 * Returns a uniformly random number in [0, n), for n > 0 (multiply-shift, bias below n / 2^64).
+	 */
+	uint64_t next_below(uint64_t n) { return (uint64_t)(((unsigned __int128)next() * n) >> 64); }
+	/*
+	 * Returns a uniformly random double in [0, 1).
+	 */
+	double next_double() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+	/*
+	 * Returns a generator for an independent stream (for another worker):
+	 * it continues the current sequence, while this generator jumps 2^128 steps ahead.
+	 */
+	Random split();
+};
+
+#endif /* RANDOM_H_ */
@@ -5,22 +5,48 @@
  *      Author: batchen
  */
 #include "sampler.h"
+#include <algorithm>
+#include <climits>
+#include <sstream>
+
+const char * strategy_name(int strategy){
+	switch (strategy){
+		case STRAT_SMTBIT: return "smtbit";
+		case STRAT_SMTBV: return "smtbv";
+		case STRAT_SAT: return "sat";
+		case STRAT_POLYTOPE: return "polytope";
+		case STRAT_GF2: return "gf2";
+		case STRAT_RANDPHASE: return "randphase";
+		default: return "unknown";
+	}
+}
+
+const char * const maxsmt_engines[] = {"maxres", "wmax", "pd-maxres"};
+const int num_maxsmt_engines = sizeof(maxsmt_engines) / sizeof(maxsmt_engines[0]);
 
-Sampler::Sampler(std::string input, int max_samples, double max_time, int max_epoch_samples, double max_epoch_time, int strategy) : original_formula(c), max_samples(max_samples), max_time(max_time), max_epoch_samples(max_epoch_samples), max_epoch_time(max_epoch_time), params(c), opt(c), solver(c),model(c){
+// timeout of the MaxSMT and SMT queries, until their latencies are known
+static const unsigned MAX_TIMEOUT_MS = 50000;
+
+Sampler::Sampler(std::string input, int max_samples, double max_time, int max_epoch_samples, double max_epoch_time, int strategy) : original_formula(c), max_samples(max_samples), max_time(max_time), max_epoch_samples(max_epoch_samples), max_epoch_time(max_epoch_time), strategy(strategy), params(c), opt(c), solver(c),model(c),watchdog(c){
 	z3::set_param("rewriter.expand_select_store", "true");
-    clock_gettime(CLOCK_REALTIME, &start_time);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-    srand(start_time.tv_sec);
+    rng.set_seed((uint64_t)time(NULL) ^ monotonic_ns());
 
-    params.set("timeout", 50000u);
+    params.set("timeout", MAX_TIMEOUT_MS);
     opt.set(params);
     solver.set(params);
 
 	parse_formula(input);
 
     compute_and_print_formula_stats();
+    ind = variables;
 
+    input_file = input;
     results_file.open(input + ".samples");
+
+    double limit = std::min(max_time, 1.0e9); // keeps the deadline in range
+    watchdog.start(monotonic_ns() + (uint64_t)(limit * 1.0e9));
 }
 
 void Sampler::initialize_solvers(){
@@ -36,13 +62,9 @@ double Sampler::get_elapsed_time(){
 	return elapsed_time_from(start_time);
 }
 
-double Sampler::get_epoch_elapsed_time(){
-	return elapsed_time_from(epoch_start_time);
-}
-
 double Sampler::elapsed_time_from(struct timespec start){
     struct timespec end;
-    clock_gettime(CLOCK_REALTIME, &end);
+    clock_gettime(CLOCK_MONOTONIC, &end);
     return duration(&start, &end);
 }
 
@@ -70,6 +92,23 @@ void Sampler::check_if_satisfiable(){
 	} else {
 		std::cout<<"Formula is satisfiable\n";
 	}
+	end_epoch();
+}
+
+void Sampler::end_epoch(){
+	solver_stats.end_epoch(strategy_name(strategy), std::cout);
+}
+
+z3::params Sampler::timeout_params(TimerCategory category, unsigned max_ms){
+	z3::params p(c);
+	if (rlimit){
+		p.set("timeout", UINT_MAX); // no timeout
+		p.set("rlimit", rlimit);
+		return p;
+	}
+	timeout_ms[category] = adaptive_timeout_ms(timers.get(category), max_ms);
+	p.set("timeout", timeout_ms[category]);
+	return p;
 }
 
 z3::check_result Sampler::solve(){
@@ -77,23 +116,44 @@ z3::check_result Sampler::solve(){
 //	std::cout<<opt.assertions()<<std::endl;
 //	std::cout<<"Opt objectives:"<<std::endl;
 //	std::cout<<opt.objectives()<<std::endl;
+	TraceScope trace("solve", "solver");
 	z3::check_result result = z3::unknown;
+	if (is_epoch_over()) {
+		return result;
+	}
+	solver_calls++;
+	unsigned max_ms = sampling ? std::max(1u, (unsigned)std::min(max_epoch_time * 1000.0, (double)MAX_TIMEOUT_MS)) : MAX_TIMEOUT_MS;
+	opt.set(timeout_params(TIMER_MAXSMT, max_ms)); // falls back to the plain solver early when MaxSMT is slower than usual
 	try {
+		ScopedTimer timer(timers, TIMER_MAXSMT);
 		result = opt.check(); //bat: first, solve a MAX-SMT instance
+		solver_stats.add("maxsmt", opt.statistics(), false);
 	} catch (z3::exception except) {
-		std::cout << "Exception: " << except << "\n";
-		//TODO exception "canceled" can be thrown when Timeout is reached
-		exit(1);
+		// "canceled" is expected when the watchdog interrupts the check
+		if (!is_epoch_over()) {
+			std::cout << "Exception: " << except << "\n";
+			exit(1);
+		}
 	}
 	if (result == z3::sat) {
 		model = opt.get_model();
-	} else if (result == z3::unknown) {
+	} else if (result == z3::unknown && !is_epoch_over() && best_maxsmt_model()) {
+		std::cout << "MAX-SMT timed out, using its best model" << "\n";
+		anytime_models++;
+		result = z3::sat;
+	} else if (result == z3::unknown && !is_epoch_over()) {
 		std::cout << "MAX-SMT timed out"<< "\n";
+		solver_calls++;
+		solver.set(timeout_params(TIMER_SMT, MAX_TIMEOUT_MS));
 		try {
+			ScopedTimer timer(timers, TIMER_SMT);
 			result = solver.check(); //bat: if too long, solve a regular SMT instance (without any soft constraints)
+			solver_stats.add("smt", solver.statistics(), true);
 		} catch (z3::exception except) {
-			std::cout << "Exception: " << except << "\n";
-			exit(1);
+			if (!is_epoch_over()) {
+				std::cout << "Exception: " << except << "\n";
+				exit(1);
+			}
 		}
 		std::cout << "SMT result: " << result << "\n";
 		if (result == z3::sat) {
@@ -103,43 +163,211 @@ z3::check_result Sampler::solve(){
 	return result;
 }
 
+/*
+ * Returns the value of the global Z3 parameter name: the one given to z3::set_param, or Z3's default.
+ */
+static std::string global_param(const char * name){
+	Z3_string value;
+	return Z3_global_param_get(name, &value) ? value : "";
+}
+
+z3::check_result Sampler::solve_random_phase(){
+	TraceScope trace("solve", "solver");
+	z3::check_result result = z3::unknown;
+	if (is_epoch_over()) {
+		return result;
+	}
+	// solver parameters have no module prefix: random_seed reaches both smt.random_seed and sat.random_seed,
+	// phase_selection is smt.phase_selection and phase is sat.phase
+	z3::params p = timeout_params(TIMER_SMT, MAX_TIMEOUT_MS);
+	p.set("random_seed", (unsigned)(rng.next() >> 32));
+	p.set("phase_selection", 5u); // random
+	p.set("phase", c.str_symbol("random"));
+	solver.set(p);
+	solver_calls++;
+	solver.push(); // in a new scope Z3 uses its incremental core, which follows these parameters
+	try {
+		ScopedTimer timer(timers, TIMER_SMT);
+		result = solver.check();
+		solver_stats.add("smt", solver.statistics(), true);
+	} catch (z3::exception except) {
+		if (!is_epoch_over()) {
+			std::cout << "Exception: " << except << "\n";
+			exit(1);
+		}
+	}
+	if (result == z3::sat) {
+		model = solver.get_model();
+	}
+	solver.pop();
+	// back to the previous values, which the solver takes from the global parameters,
+	// so that the SMT fallback of the other strategies (under --auto) is unaffected
+	p.set("random_seed", (unsigned)strtoul(global_param("smt.random_seed").c_str(), NULL, 10));
+	p.set("phase_selection", (unsigned)strtoul(global_param("smt.phase_selection").c_str(), NULL, 10));
+	p.set("phase", c.str_symbol(global_param("sat.phase").c_str()));
+	solver.set(p);
+	return result;
+}
+
+void Sampler::start_pipeline(){
+	if (num_arrays || num_uf || num_reals) {
+		std::cout << "Pipeline: not supported with arrays, uninterpreted functions or reals" << std::endl;
+		return;
+	}
+	if (strategy == STRAT_RANDPHASE) {
+		std::cout << "Pipeline: not used by " << strategy_name(strategy) << std::endl;
+		return;
+	}
+	std::vector<std::string> ind_names;
+	for (z3::func_decl & v : ind) {
+		ind_names.push_back(v.name().str());
+	}
+	std::unordered_map<std::string, std::vector<bool>> support;
+	for (auto & s : support_bits) {
+		support[z3::func_decl(c, s.first).name().str()] = s.second;
+	}
+	std::vector<std::string> output_names;
+	for (z3::func_decl & v : variables) {
+		if (v.arity() == 0 && (v.range().is_bool() || v.range().is_bv() || v.range().is_int())) {
+			pipeline_vars.push_back(v);
+			output_names.push_back(v.name().str());
+		}
+	}
+	pipeline.reset(new EpochPipeline(input_file, ind_names, support, output_names, random_soft_bit, rng.split(), 2,
+			MAX_TIMEOUT_MS, rlimit, maxsmt_engine));
+	pipeline->start(watchdog.get_deadline());
+	std::cout << "Pipeline: started" << std::endl;
+}
+
+z3::check_result Sampler::next_pipelined_model(){
+	std::vector<std::string> values;
+	bool popped = pipeline->pop(values, [this]{ return should_stop(); });
+	for (const SolverStatistics::Counters & s : pipeline->take_stats()) {
+		solver_stats.add_counters("pipeline", s);
+	}
+	if (!popped) {
+		return z3::unknown;
+	}
+	std::vector<z3::expr> exprs;
+	for (size_t i = 0; i < pipeline_vars.size(); i++) {
+		z3::sort s = pipeline_vars[i].range();
+		if (s.is_bool()) {
+			exprs.push_back(c.bool_val(values[i] == "1"));
+		} else if (s.is_bv()) {
+			exprs.push_back(z3::expr(c, parse_bv(values[i].c_str(), s, c)));
+		} else {
+			exprs.push_back(c.int_val(values[i].c_str()));
+		}
+	}
+	z3::model m = model_with_values(model, pipeline_vars, exprs);
+	if (!m.eval(original_formula, true).is_true()) {
+		std::cout << "Pipeline: model does not satisfy the formula" << std::endl;
+		return z3::unknown;
+	}
+	model = m;
+	return z3::sat;
+}
+
+bool Sampler::best_maxsmt_model(){
+	z3::model best(c);
+	try {
+		best = opt.get_model(); // the best assignment found before the timeout (empty if none)
+	} catch (z3::exception except) {
+		return false;
+	}
+	if (best.size() == 0 || !best.eval(original_formula, true).is_true()) {
+		return false;
+	}
+	model = best;
+	return true;
+}
+
 bool Sampler::is_time_limit_reached(){
-    struct timespec now;
-    clock_gettime(CLOCK_REALTIME, &now);
-    double elapsed = duration(&start_time, &now);
-    if (elapsed >= max_time) {
-        std::cout << "Stopping: timeout\n";
-        finish();
-    }
+    return watchdog.is_expired();
+}
+
+bool Sampler::should_stop(){
+    return stop_requested.load(std::memory_order_relaxed) || watchdog.is_expired();
+}
+
+bool Sampler::is_epoch_over(){
+    return should_stop() || watchdog.is_epoch_expired() || epoch_samples >= max_epoch_samples;
 }
 
 void Sampler::finish() {
+    watchdog.stop();
+    if (is_time_limit_reached()) {
+        std::cout << "Stopping: timeout\n";
+    }
+    if (pipeline) {
+        pipeline->stop();
+        for (const SolverStatistics::Counters & s : pipeline->take_stats()) {
+            solver_stats.add_counters("pipeline", s);
+        }
+        std::cout << "Pipeline: " << pipeline->get_produced() << " epoch models produced" << std::endl;
+    }
+    if (metrics) {
+        metrics->stop();
+    }
     print_stats();
+    trace_finish();
     results_file.close();
     exit(0);
 }
 
 void Sampler::print_stats(){
 	std::cout<<"---------SOLVING STATISTICS--------"<<std::endl;
-	for(auto it = accumulated_times.cbegin(); it != accumulated_times.cend(); ++it)
-	{
-	    std::cout << it->first << " time: " << it->second << std::endl;
+	timers.print(std::cout);
+	if (!rlimit){
+		std::cout<<"Timeouts (ms):";
+		for (int i = 0; i < NUM_TIMERS; i++){
+			if (timeout_ms[i]){
+				std::cout<<' '<<timer_name((TimerCategory)i)<<": "<<timeout_ms[i];
+			}
+		}
+		std::cout<<std::endl;
 	}
+	std::cout<<"total time: "<<get_elapsed_time()<<std::endl;
+	std::cout<<"rlimit used: "<<solver_stats.get_rlimit()<<std::endl;
+	std::cout<<"rlimit per sample: "<<(unique_valid_samples ? solver_stats.get_rlimit() / unique_valid_samples : 0.0)<<std::endl;
+	solver_stats.end_epoch(strategy_name(strategy), std::cout);
+	solver_stats.print(std::cout);
 	std::cout<<"Epochs: "<<epochs<<std::endl;
+	std::cout<<"Anytime MaxSMT models: "<<anytime_models<<std::endl;
 	std::cout<<"Assignments considered (with repetitions): "<<total_samples<<std::endl;
 	std::cout<<"Models (with repetitions): "<<valid_samples<<std::endl;
 	std::cout<<"Unique models (# samples in file): "<<unique_valid_samples<<std::endl;
+	std::cout<<"Unique rate (unique / all models): "<<(valid_samples ? (double)unique_valid_samples / valid_samples : 0.0)<<std::endl;
+	if (coverage){
+		std::cout << "Coverage bool: " << coverage_bool - coverage_all_bool << '/' << coverage_all_bool << ", coverage bv " << coverage_bv - coverage_all_bv << '/' << coverage_all_bv << std::endl;
+	}
 	std::cout<<"-----------------------------------"<<std::endl;
 }
 
 z3::model Sampler::start_epoch(){
+	ScopedTimer timer(timers, TIMER_START_EPOCH);
 	std::cout<<"Starting an epoch"<<std::endl;
-
-    opt.push(); // because formula is constant, but other hard/soft constraints change between epochs
-    choose_random_assignment();
-    z3::check_result result = solve(); //bat: find closest solution to random assignment (or some solution)
+	epoch_samples = 0;
+	sampling = true;
+	watchdog.set_epoch_deadline(0); // the epoch time limit applies once the epoch model is found, its MaxSMT query is limited in solve
+
+    z3::check_result result;
+    if (pipeline) {
+    	result = next_pipelined_model();
+    } else if (strategy == STRAT_RANDPHASE) {
+    	result = solve_random_phase();
+    } else {
+    	opt.push(); // because formula is constant, but other hard/soft constraints change between epochs
+    	choose_random_assignment();
+    	result = solve(); //bat: find closest solution to random assignment (or some solution)
+    	opt.pop();
+    }
     assert(result != z3::unsat);
-    opt.pop();
+    if (result != z3::sat) { // interrupted at the time limit, or the solver gave up
+    	std::cout << "Epoch: no model found" << std::endl;
+    	return model;
+    }
+    watchdog.set_epoch_deadline(monotonic_ns() + (uint64_t)(std::min(max_epoch_time, 1.0e9) * 1.0e9));
 
     epochs++;
     total_samples++;
@@ -147,55 +375,63 @@ z3::model Sampler::start_epoch(){
 
 //    save_and_output_sample_if_unique(Z3_model_to_string(c,model));
     //TODO assert model satisfies formula
-    save_and_output_sample_if_unique(model_to_string(model));
+    if (save_and_output_sample_if_unique(model_to_string(model))){
+    	measure_coverage(model);
+    }
+    output_free_fillings(model);
 
 	return model;
 }
 
-void Sampler::choose_random_assignment(){
-    for (z3::func_decl & v : variables) { //bat: Choose a random assignment: for variable-> if bv or bool, randomly choose a value to it.
+void add_random_targets(z3::optimize & opt, Random & rng, const std::vector<z3::func_decl> & ind,
+		const std::unordered_map<Z3_func_decl, std::vector<bool>> & support_bits, bool soft_bits){
+	z3::context & c = opt.ctx();
+	auto assert_soft = [&](const z3::expr & e){ opt.add(e, 1); };
+    for (const z3::func_decl & v : ind) { //bat: Choose a random assignment: for variable-> if bv or bool, randomly choose a value to it.
 		if (v.arity() > 0 || v.range().is_array())
 			continue;
 		switch (v.range().sort_kind()) {
 			case Z3_BV_SORT: // random assignment to bv
 			{
-				if (random_soft_bit) {
-					for (int i = 0; i < v.range().bv_size(); ++i) {
-						if (rand() % 2)
+				auto bits = support_bits.find(v);
+				int size = v.range().bv_size();
+				if (soft_bits) {
+					for (int i = 0; i < size; ++i) {
+						if (bits != support_bits.end() && !bits->second[i])
+							continue;
+						if (rng.next_bool())
 							assert_soft(v().extract(i, i) == c.bv_val(0, 1));
 						else
 							assert_soft(v().extract(i, i) != c.bv_val(0, 1));
 					}
+				} else if (bits == support_bits.end()) {
+					assert_soft(v() == random_bv(c, rng, size));
 				} else {
-					std::string n;
-					char num[10];
-					int i = v.range().bv_size();
-					if (i % 4) {
-						snprintf(num, 10, "%x", rand() & ((1<<(i%4)) - 1));
-						n += num;
-						i -= (i % 4);
-					}
-					while (i) {
-						snprintf(num, 10, "%x", rand() & 15);
-						n += num;
-						i -= 4;
+					// one target for each range of consecutive support bits
+					for (int lo = 0; lo < size; ) {
+						if (!bits->second[lo]) {
+							++lo;
+							continue;
+						}
+						int hi = lo;
+						while (hi + 1 < size && bits->second[hi + 1])
+							++hi;
+						assert_soft(v().extract(hi, lo) == random_bv(c, rng, hi - lo + 1));
+						lo = hi + 1;
 					}
-					Z3_ast ast = parse_bv(n.c_str(), v.range(), c);
-					z3::expr exp(c, ast);
-					assert_soft(v() == exp);
 				}
 				break; // from switch, bv case
 			}
 			case Z3_BOOL_SORT: // random assignment to bool var
-				if (rand() % 2)
+				if (rng.next_bool())
 					assert_soft(v());
 				else
 					assert_soft(!v());
 				break; // from switch, bool case
 			case Z3_INT_SORT: // random assignment to bool var
 			{
-				int random = rand();
-				if (rand() % 2)
+				int random = (int)(rng.next() >> 33);
+				if (rng.next_bool())
 					assert_soft(v() == c.int_val(random));
 				else
 					assert_soft(v() == c.int_val(-random));
@@ -209,6 +445,193 @@ void Sampler::choose_random_assignment(){
     } //end for: random assignment chosen
 }
 
+void Sampler::choose_random_assignment(){
+	add_random_targets(opt, rng, ind, support_bits, random_soft_bit);
+}
+
+z3::expr random_bv(z3::context & c, Random & rng, int size){
+	std::vector<uint64_t> words((size + 63) / 64);
+	for (uint64_t & w : words)
+		w = rng.next();
+	return bv_from_words(c, words, size);
+}
+
+z3::expr Sampler::random_bv_value(int size){
+	return random_bv(c, rng, size);
+}
+
+z3::expr Sampler::bv_from_bits(const std::vector<bool> & bits){
+	std::vector<uint64_t> words((bits.size() + 63) / 64, 0);
+	for (size_t i = 0; i < bits.size(); ++i) {
+		if (bits[i])
+			words[i / 64] |= (uint64_t)1 << (i % 64);
+	}
+	return bv_from_words(words, bits.size());
+}
+
+z3::expr Sampler::bv_from_words(const std::vector<uint64_t> & words, int size){
+	return ::bv_from_words(c, words, size);
+}
+
+z3::expr bv_from_words(z3::context & c, const std::vector<uint64_t> & words, int size){
+	// the most significant word only holds the remaining bits, the others are concatenated below it
+	int top = size - 64 * ((int)words.size() - 1);
+	uint64_t top_value = top == 64 ? words.back() : words.back() & (((uint64_t)1 << top) - 1);
+	z3::expr res(c, Z3_mk_unsigned_int64(c, top_value, c.bv_sort(top)));
+	for (int i = (int)words.size() - 2; i >= 0; --i)
+		res = z3::concat(res, z3::expr(c, Z3_mk_unsigned_int64(c, words[i], c.bv_sort(64))));
+	return res;
+}
+
+void Sampler::output_free_fillings(const z3::model & m){
+	if (free_bits.empty()){
+		return;
+	}
+	TraceScope trace("output_batch", "output");
+	std::vector<z3::func_decl> decls;
+	std::vector<z3::expr> base_values;
+	std::vector<z3::expr> masks;
+	for (z3::func_decl & v : variables){
+		auto it = free_bits.find(v);
+		if (it == free_bits.end()){
+			continue;
+		}
+		decls.push_back(v);
+		base_values.push_back(m.eval(v(), true));
+		masks.push_back(v.range().is_bv() ? bv_from_bits(it->second) : c.bool_val(true));
+	}
+	for (int k = 0; k < free_fill_samples; k++){
+		std::vector<z3::expr> values;
+		for (size_t i = 0; i < decls.size(); i++){
+			switch (decls[i].range().sort_kind()) {
+				case Z3_BV_SORT:
+				{
+					z3::expr r = random_bv_value(decls[i].range().bv_size());
+					values.push_back(((base_values[i] & ~masks[i]) | (r & masks[i])).simplify());
+					break;
+				}
+				case Z3_BOOL_SORT:
+					values.push_back(c.bool_val(rng.next_bool()));
+					break;
+				default: // Int
+				{
+					int random = (int)(rng.next() >> 33);
+					values.push_back(c.int_val(rng.next_bool() ? random : -random));
+				}
+			}
+		}
+		total_samples++;
+		valid_samples++;
+		save_and_output_sample_if_unique(model_to_string(model_with_values(m, decls, values)));
+	}
+}
+
+void Sampler::set_support_time(double time){
+	support_time = time;
+}
+
+void Sampler::set_free_fill_samples(int samples){
+	free_fill_samples = samples;
+}
+
+void Sampler::set_seed(uint64_t seed){
+	std::cout << "Seed: " << seed << std::endl;
+	rng.set_seed(seed);
+}
+
+void Sampler::set_rlimit(unsigned limit){
+	std::cout << "Resource limit per query: " << limit << std::endl;
+	rlimit = limit;
+}
+
+void Sampler::set_maxsmt_engine(const std::string & engine){
+	std::cout << "MaxSMT engine: " << engine << std::endl;
+	maxsmt_engine = engine;
+	z3::params p(c);
+	p.set("maxsat_engine", c.str_symbol(engine.c_str()));
+	opt.set(p);
+}
+
+void Sampler::choose_maxsmt_engine(int probe_epochs){
+	if (strategy == STRAT_RANDPHASE){
+		return; // no MaxSMT queries
+	}
+	// fallbacks to the plain solver are part of the cost of an engine
+	auto cost = [this]{ return rlimit ? solver_stats.get_rlimit() : timers.get(TIMER_MAXSMT).get_total() + timers.get(TIMER_SMT).get_total(); };
+	std::string best;
+	double best_cost = 0;
+	for (int i = 0; i < num_maxsmt_engines && !should_stop(); i++){
+		set_maxsmt_engine(maxsmt_engines[i]);
+		double start = cost();
+		int probes = 0;
+		while (probes < probe_epochs && !should_stop()){
+			start_epoch();
+			end_epoch();
+			++probes;
+			if (!best.empty() && cost() - start > best_cost * probe_epochs){
+				break; // already slower than the best engine over all its probes
+			}
+		}
+		double per_epoch = (cost() - start) / probes;
+		std::cout << "MaxSMT engine probe: " << maxsmt_engines[i] << ", " << per_epoch << (rlimit ? " rlimit" : " s") << " per epoch over " << probes << " epochs" << std::endl;
+		if (best.empty() || per_epoch < best_cost){
+			best = maxsmt_engines[i];
+			best_cost = per_epoch;
+		}
+	}
+	if (!best.empty()){
+		set_maxsmt_engine(best);
+	}
+}
+
+void Sampler::set_coverage(bool enable){
+	coverage = enable;
+	if (coverage){
+		// registers the nodes of the formula, the model is not used
+		coverage_enable = 1;
+		model.eval(original_formula, true);
+		coverage_enable = 0;
+	}
+}
+
+void Sampler::start_metrics(const std::string & target, double interval){
+	metrics.reset(new MetricsExporter(target, interval, [this]{ return metrics_text(); }));
+	if (!metrics->start()){
+		metrics.reset();
+	}
+}
+
+static void metric(std::ostringstream & out, const char * name, const char * type, const char * help, double value){
+	out << "# HELP smtsampler_" << name << ' ' << help << '\n';
+	out << "# TYPE smtsampler_" << name << ' ' << type << '\n';
+	out << "smtsampler_" << name << ' ' << value << '\n';
+}
+
+std::string Sampler::metrics_text(){
+	std::ostringstream out;
+	out.precision(15);
+	metric(out, "epochs_total", "counter", "Epochs started.", epochs);
+	metric(out, "samples_total", "counter", "Assignments considered (with repetitions).", total_samples);
+	metric(out, "valid_samples_total", "counter", "Valid samples (with repetitions).", valid_samples);
+	metric(out, "unique_valid_samples_total", "counter", "Unique valid samples written to the results file.", unique_valid_samples);
+	metric(out, "dedupe_set_size", "gauge", "Samples held in the deduplication set.", unique_valid_samples);
+	metric(out, "solver_calls_total", "counter", "Solver checks.", solver_calls);
+	metric(out, "anytime_models_total", "counter", "Epoch models taken from a timed out MaxSMT query.", anytime_models);
+	metric(out, "elapsed_seconds", "gauge", "Time since sampling started.", get_elapsed_time());
+	metric(out, "resident_memory_bytes", "gauge", "Resident set size.", resident_memory_bytes());
+	out << "# HELP smtsampler_phase_seconds_total Time spent in each phase.\n";
+	out << "# TYPE smtsampler_phase_seconds_total counter\n";
+	for (int i = 0; i < NUM_TIMERS; i++){
+		out << "smtsampler_phase_seconds_total{phase=\"" << timer_name((TimerCategory)i) << "\"} " << timers.get((TimerCategory)i).get_total() << '\n';
+	}
+	out << "# HELP smtsampler_phase_calls_total Measurements of each phase.\n";
+	out << "# TYPE smtsampler_phase_calls_total counter\n";
+	for (int i = 0; i < NUM_TIMERS; i++){
+		out << "smtsampler_phase_calls_total{phase=\"" << timer_name((TimerCategory)i) << "\"} " << timers.get((TimerCategory)i).get_count() << '\n';
+	}
+	return out.str();
+}
+
 void Sampler::do_epoch(const z3::model & model){
 	std::cout<<"Epoch: keeping only original model"<<std::endl;
 }
@@ -290,12 +713,88 @@ void Sampler::assert_soft(z3::expr const & e) {
     opt.add(e, 1);
 }
 
-void Sampler::save_and_output_sample_if_unique(const std::string & sample){
+bool Sampler::save_and_output_sample_if_unique(const std::string & sample){
+    if (epoch_samples >= max_epoch_samples) {
+    	return false; // the epoch is over
+    }
     auto res = samples.insert(sample);
     if (res.second) {
-    	unique_valid_samples++;
+    	++epoch_samples;
+    	if (++unique_valid_samples == 1){
+    		std::cout << "First sample time: " << get_elapsed_time() << std::endl;
+    	}
+    	if (unique_valid_samples == max_samples){
+    		std::cout << "Stopping: samples" << std::endl;
+    		stop_requested = true;
+    	}
     	results_file << unique_valid_samples << ": " << sample << std::endl;
     }
+    return res.second;
+}
+
+void Sampler::measure_coverage(const z3::model & m){
+	if (!coverage){
+		return;
+	}
+	ScopedTimer timer(timers, TIMER_COVERAGE);
+	coverage_enable = 2;
+	m.eval(original_formula, true);
+	coverage_enable = 0;
+}
+
+bool Sampler::check_and_output_sample(const z3::model & m){
+	total_samples++;
+	{
+		ScopedTimer timer(timers, TIMER_VALIDATION);
+		z3::expr b = m.eval(original_formula, true);
+		if (b.bool_value() != Z3_L_TRUE){
+			return false;
+		}
+	}
+	valid_samples++;
+	if (save_and_output_sample_if_unique(model_to_string(m))){
+		measure_coverage(m);
+	}
+	output_free_fillings(m);
+	return true;
+}
+
+z3::model Sampler::model_with_values(const z3::model & m, const std::vector<z3::func_decl> & decls, const std::vector<z3::expr> & values){
+	assert(decls.size() == values.size());
+	z3::model res(c);
+	std::unordered_set<Z3_func_decl> replaced;
+	for (size_t i = 0; i < decls.size(); i++){
+		z3::func_decl v = decls[i];
+		z3::expr val = values[i];
+		res.add_const_interp(v, val);
+		replaced.insert(v);
+	}
+	for (unsigned i = 0; i < m.num_consts(); i++){
+		z3::func_decl v = m.get_const_decl(i);
+		if (replaced.find(v) == replaced.end()){
+			z3::expr val = m.get_const_interp(v);
+			res.add_const_interp(v, val);
+		}
+	}
+	for (unsigned i = 0; i < m.num_funcs(); i++){ // uninterpreted functions and array interpretations
+		z3::func_decl f = m.get_func_decl(i);
+		z3::func_interp fi = m.get_func_interp(f);
+		z3::expr def = fi.else_value();
+		z3::func_interp new_fi = res.add_func_interp(f, def);
+		for (unsigned j = 0; j < fi.num_entries(); j++){
+			z3::expr_vector args(c);
+			for (unsigned k = 0; k < fi.entry(j).num_args(); k++){
+				args.push_back(fi.entry(j).arg(k));
+			}
+			z3::expr val = fi.entry(j).value();
+			new_fi.add_entry(args, val);
+		}
+	}
+	for (auto & def : definitions){
+		z3::expr val = res.eval(def.second, true);
+		res.add_const_interp(def.first, val);
+	}
+	return res;
 }
 
 std::string Sampler::model_to_string(const z3::model & m){
@@ -399,30 +898,6 @@ std::string Sampler::model_to_string(const z3::model & m){
     return s;
 }
 
-void Sampler::set_timer_on(const std::string & category){
-	if (is_timer_on.find(category)!=is_timer_on.end() && is_timer_on[category]){ // category was inserted to map and its value was set to true
-		std::cout<<"WARNING: starting timer twice for category "<<category<<std::endl;
-	}
-	struct timespec now;
-	clock_gettime(CLOCK_REALTIME, &now);
-	timer_start_times[category] = now;
-	is_timer_on[category] = true;
-}
-
-void Sampler::accumulate_time(const std::string & category){
-	if (is_timer_on.find(category)==is_timer_on.end() || is_timer_on[category]==false){ // timer never went on
-			std::cout<<"ERROR: cannot stop timer for category: "<<category<<". Timer was never started."<<std::endl;
-			finish();
-			exit(1); //TODO add exception handling
-	}
-
-	assert(timer_start_times.find(category)!=timer_start_times.end());
-	struct timespec now;
-	clock_gettime(CLOCK_REALTIME, &now);
-	if (accumulated_times.find(category)==accumulated_times.end()){
-		accumulated_times[category] = 0.0;
-	}
-    accumulated_times[category] += duration(&timer_start_times[category], &now);
-
-    is_timer_on[category] = false;
+Timers & Sampler::get_timers(){
+	return timers;
 }
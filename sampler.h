@@ -11,44 +11,115 @@
 #include <z3++.h>
 #include <fstream> //for results_file
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <vector>
 #include <algorithm> // for std::find
+#include "timers.h"
+#include "solver_stats.h"
+#include "metrics.h"
+#include "trace.h"
+#include "random.h"
+#include "watchdog.h"
+#include "pipeline.h"
+#include <atomic>
+#include <memory>
 
 
+enum {
+STRAT_SMTBIT,
+STRAT_SMTBV,
+STRAT_SAT,
+STRAT_POLYTOPE,
+STRAT_GF2,
+STRAT_RANDPHASE
+};
+
+/*
+ * Returns the name of a strategy, as used on the command line.
+ */
+const char * strategy_name(int strategy);
+
+/*
+ * The MaxSAT engines of z3::optimize that can be chosen with --maxsmt-engine.
+ */
+extern const char * const maxsmt_engines[];
+extern const int num_maxsmt_engines;
+
 Z3_ast parse_bv(char const * n, Z3_sort s, Z3_context ctx);
 std::string bv_string(Z3_ast ast, Z3_context ctx);
 
+/*
+ * Adds to opt a soft constraint (weight 1) for a random target value of each variable in ind.
+ * Bit-vectors in support_bits only get targets for their support bits; with soft_bits, every bit
+ * of a target is a soft constraint of its own.
+ */
+void add_random_targets(z3::optimize & opt, Random & rng, const std::vector<z3::func_decl> & ind,
+		const std::unordered_map<Z3_func_decl, std::vector<bool>> & support_bits, bool soft_bits);
+/*
+ * Returns a uniformly random bit-vector numeral of the given size.
+ */
+z3::expr random_bv(z3::context & c, Random & rng, int size);
+/*
+ * Returns the bit-vector of the given size whose bits are given as 64-bit words (least significant first).
+ * Numerals are built directly from the words; vectors wider than 64 bits are concatenations of them.
+ */
+z3::expr bv_from_words(z3::context & c, const std::vector<uint64_t> & words, int size);
+
+extern int coverage_enable;
+extern int coverage_bool;
+extern int coverage_bv;
+extern int coverage_all_bool;
+extern int coverage_all_bv;
+
 class Sampler{
 
 protected:
     //Settings
     bool random_soft_bit = false; //TODO enable change from cmd line
+    int strategy;
+    double support_time = 0.0; // time budget for computing a bit-level independent support (0 disables it)
+    int free_fill_samples = 10; // random fillings of the unconstrained bits output for each valid sample
+    bool coverage = false; // measure which values the nodes of the formula take over all unique samples
 
     //Time management
 	struct timespec start_time;
-	struct timespec epoch_start_time;
-	//TODO take these max values into account during computation
 	int max_samples;
 	double max_time;
 	int max_epoch_samples;
 	double max_epoch_time;
-    std::map<std::string, struct timespec> timer_start_times;
-    std::map<std::string, bool> is_timer_on;
-    std::map<std::string, double> accumulated_times;
+	int epoch_samples = 0; // unique samples output in the current epoch
+	bool sampling = false; // set by the first epoch, from then on no MaxSMT query runs longer than max_epoch_time
+    Timers timers;
+    unsigned timeout_ms[NUM_TIMERS] = {}; // last timeout given to each class of solver queries (0 if never used)
+    unsigned rlimit = 0; // resource limit of every solver query, replacing the timeouts (0 if not set)
+    std::string maxsmt_engine; // MaxSAT engine of opt (empty for Z3's default)
+    SolverStatistics solver_stats;
+    Random rng;
 
     //Formula statistics
     int num_arrays = 0, num_bv = 0, num_bools = 0, num_bits = 0, num_uf = 0, num_ints = 0, num_reals = 0;
     std::vector<z3::func_decl> variables;
+    std::vector<z3::func_decl> ind; // independent support: random targets are only chosen for these
+    std::vector<std::pair<z3::func_decl, z3::expr>> definitions; // variables defined by others (x = f(y, z)), in topological order
+    std::unordered_map<Z3_func_decl, std::vector<bool>> support_bits; // bits in the support, for bit-vectors in ind that are only partially in it
+    std::unordered_map<Z3_func_decl, std::vector<bool>> free_bits; // bits that cannot influence the formula (a single entry for Bools and Ints)
     std::unordered_set<std::string> var_names = {"bv", "Int", "true", "false"}; //initialize with constant names so that constants are not mistaken for variables
     int max_depth = 0;
     std::unordered_set<Z3_ast> sup; //bat: nodes (=leaves?)
 
-    //Other statistics
-    int epochs = 0;
-    int total_samples = 0; // how many samples we stumbled upon (repetitions are counted multiple times)
-    int valid_samples = 0; // how many samples were valid (repetitions are counted multiple times)
-    int unique_valid_samples = 0; //how many different valid samples were found (should always equal the size of the samples set and the number of lines in the results file)
+    //Other statistics (atomic, since they are read by the metrics exporter thread)
+    std::atomic<int> epochs{0};
+    std::atomic<int> total_samples{0}; // how many samples we stumbled upon (repetitions are counted multiple times)
+    std::atomic<int> valid_samples{0}; // how many samples were valid (repetitions are counted multiple times)
+    std::atomic<int> unique_valid_samples{0}; //how many different valid samples were found (should always equal the size of the samples set and the number of lines in the results file)
+    std::atomic<int> solver_calls{0};
+    std::atomic<int> anytime_models{0}; // epoch models taken from a MaxSMT query that timed out
+    std::unique_ptr<MetricsExporter> metrics;
+    std::unique_ptr<EpochPipeline> pipeline; // computes epoch models in another thread (--pipeline)
+    std::vector<z3::func_decl> pipeline_vars; // variables whose values the pipeline passes on, in its order
+    std::string input_file;
+    std::atomic<bool> stop_requested{false}; // set once max_samples unique samples were output
 
     //Z3 objects
     z3::context c;
@@ -57,6 +128,7 @@ protected:
     z3::optimize opt;
     z3::solver solver;
     z3::model model;
+    Watchdog watchdog; // interrupts c at the global and epoch deadlines
 
     //Samples
     std::ofstream results_file;
@@ -84,8 +156,14 @@ public:
     void check_if_satisfiable();
     /*
      * Generates and returns a model to begin a new epoch.
+     * Time spent is measured under TIMER_START_EPOCH.
      */
     z3::model start_epoch();
+    /*
+     * Closes the solver statistics of the current epoch, counting them under the current strategy.
+     * Must be called before the strategy changes.
+     */
+    void end_epoch();
     /*
      * Sampling epoch: generates multiple valid samples from the given model.
      * Whenever a sample is produced we check if it was produced before (i.e., belongs to the samples set).
@@ -96,53 +174,160 @@ public:
      * Returns the time that has passed since the sampling process began (since this was created).
      */
     double get_elapsed_time();
-    /*
-     * Returns the time that has passed since the last epoch has began (since start_epoch was last called).
-     */
-    double get_epoch_elapsed_time();
     /*
      * Prints stats and closes results file.
      */
     void finish();
     /*
-     * Starts measuring time under the given category.
+     * Returns the timers measuring the sampling phases (used with ScopedTimer).
      */
-    void set_timer_on(const std::string & category);
+    Timers & get_timers();
     /*
-     * Stops measuring time under the given category (should always be preceded by a matching call to set_timer_on(category)).
-     * The time difference from when the timer went on to now is added to the accumulated time for that category
-     * (in map accumulated_times).
+     * Returns whether the global time limit has passed (as detected by the watchdog).
      */
-    void accumulate_time(const std::string & category);
+    bool is_time_limit_reached();
     /*
-     * Checks if global timeout is reached.
-     * If so, calls finish.
+     * Returns whether sampling should stop: the time limit has passed or max_samples unique samples were output.
      */
-    bool is_time_limit_reached();
-    // TODO handle timeouts
+    bool should_stop();
+    /*
+     * Returns whether the current epoch should end: sampling should stop, the epoch time limit has passed
+     * or max_epoch_samples unique samples were output in it. Cheap enough to be checked for every sample.
+     */
+    bool is_epoch_over();
+    /*
+     * Sets the time budget (in seconds) for computing a bit-level independent support before sampling.
+     */
+    void set_support_time(double time);
+    /*
+     * Sets how many random fillings of the unconstrained bits are output for each solver model.
+     */
+    void set_free_fill_samples(int samples);
+    /*
+     * Enables measuring the coverage of the formula nodes by the unique samples (as the original SMTSampler does).
+     * Only meaningful with the patched Z3, which implements coverage_enable.
+     */
+    void set_coverage(bool enable);
+    /*
+     * Restarts the random number generator from seed, so that runs can be reproduced.
+     */
+    void set_seed(uint64_t seed);
+    /*
+     * Budgets every solver query with the given Z3 resource limit instead of a timeout,
+     * so that, with a fixed seed, the same samples are found on any machine.
+     */
+    void set_rlimit(unsigned limit);
+    /*
+     * Sets the MaxSAT engine of opt ("maxres", "wmax" or "pd-maxres").
+     */
+    void set_maxsmt_engine(const std::string & engine);
+    /*
+     * Runs probe_epochs epochs (start_epoch only) with each MaxSAT engine and keeps the one whose
+     * MaxSMT queries were cheapest: in time, or in resources if a resource limit was set.
+     * The models found while probing are output like any other epoch model.
+     */
+    void choose_maxsmt_engine(int probe_epochs);
+    /*
+     * Starts publishing live metrics (see metrics_text) to target every interval seconds.
+     * target is a file path or "unix:<path>" for a Unix domain socket.
+     */
+    void start_metrics(const std::string & target, double interval);
+    /*
+     * Returns counters and phase times in Prometheus text format.
+     * Safe to call from another thread while sampling.
+     */
+    std::string metrics_text();
+    /*
+     * From now on, epoch models are computed ahead by an EpochPipeline (in its own thread and context)
+     * while the current epoch is sampled. Not supported for formulas with arrays, uninterpreted functions
+     * or reals, and not used by STRAT_RANDPHASE.
+     */
+    void start_pipeline();
 
 
 protected:
 	double duration(struct timespec * a, struct timespec * b);
 	double elapsed_time_from(struct timespec start);
 	void parse_formula(std::string input);
+	/*
+	 * Returns parameters setting the timeout of the next query of the given class (timed under category),
+	 * adapted to the latencies of the previous ones and at most max_ms (see adaptive_timeout_ms).
+	 * If a resource limit was set, the query is limited by it instead.
+	 */
+	z3::params timeout_params(TimerCategory category, unsigned max_ms);
 	void compute_and_print_formula_stats();
     void _compute_formula_stats_aux(z3::expr e, int depth = 0);
     void assert_soft(z3::expr const & e);
-    void save_and_output_sample_if_unique(const std::string & sample);
+    /*
+     * Adds sample to the samples set and outputs it if it was not there before.
+     * Returns whether it was new. Once max_epoch_samples were output in the current epoch, nothing is output.
+     */
+    bool save_and_output_sample_if_unique(const std::string & sample);
+    /*
+     * Records the values that the formula nodes take under m (if coverage is enabled).
+     */
+    void measure_coverage(const z3::model & m);
     std::string model_to_string(const z3::model & model);
     /*
-     * Assigns a random value to all variables and
+     * Returns a copy of m where each variable in decls is interpreted as the matching entry of values.
+     * Defined variables are then recomputed from their definitions.
+     */
+    z3::model model_with_values(const z3::model & m, const std::vector<z3::func_decl> & decls, const std::vector<z3::expr> & values);
+    /*
+     * Counts m as a considered assignment and evaluates original_formula under it.
+     * If m is a solution, it is counted as valid and output (if unique), followed by its free fillings
+     * (which are output even when m itself was not new).
+     * Returns whether m satisfies the formula.
+     */
+    bool check_and_output_sample(const z3::model & m);
+    /*
+     * Assigns a random value to all variables in ind and
      * adds equivalence constraints as soft constraints to opt.
      */
     void choose_random_assignment();
+    /*
+     * Returns random_bv(c, rng, size).
+     */
+    z3::expr random_bv_value(int size);
+    /*
+     * Returns the bit-vector numeral whose bits are given (least significant first).
+     */
+    z3::expr bv_from_bits(const std::vector<bool> & bits);
+    /*
+     * Returns bv_from_words(c, words, size).
+     */
+    z3::expr bv_from_words(const std::vector<uint64_t> & words, int size);
+    /*
+     * Outputs free_fill_samples copies of m where the bits in free_bits are chosen at random.
+     * These bits do not influence the formula, so the copies are valid without any check.
+     */
+    void output_free_fillings(const z3::model & m);
 	/*
-	 * Tries to solve optimized formula (using opt).
-	 * If too long, resorts to regular formula (using solver).
+	 * Tries to solve optimized formula (using opt), for at most max_epoch_time once sampling started.
+	 * If it times out, keeps the best model the optimizer found so far if it satisfies the formula,
+	 * and otherwise resorts to regular formula (using solver).
+	 * Returns unknown without solving once the epoch is over, and when interrupted by the watchdog.
 	 * Check result (sat/unsat/unknown) is returned.
 	 * If sat - model is put in model variable.
 	 */
 	z3::check_result solve();
+	/*
+	 * After opt timed out, stores the best model it found in model, if it satisfies the formula.
+	 * Returns whether it did.
+	 */
+	bool best_maxsmt_model();
+	/*
+	 * Takes the next model from the pipeline and stores it in model, if it satisfies the formula.
+	 * Returns unknown if sampling stopped while waiting for it.
+	 */
+	z3::check_result next_pipelined_model();
+	/*
+	 * Solves the formula with the plain solver (no soft constraints), after re-seeding the random choices of its
+	 * smt and sat modules and switching them to random phase selection, so that every call gives a different model
+	 * (STRAT_RANDPHASE). The previous seeds and phase selection are restored afterwards.
+	 * If sat - model is put in model variable.
+	 */
+	z3::check_result solve_random_phase();
 	/*
 	 * Prints statistic information about the sampling procedure:
 	 * number of samples and epochs and time spent on each phase.
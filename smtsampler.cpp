@@ -2,6 +2,7 @@
 #include <z3++.h>
 #include <vector>
 #include <map>
+#include <deque>
 #include <unordered_set>
 #include <unordered_map>
 #include <algorithm>
@@ -9,12 +10,8 @@
 #include <iostream>
 #include <stdlib.h>
 #include "megasampler.h"
-
-enum {
-STRAT_SMTBIT,
-STRAT_SMTBV,
-STRAT_SAT
-};
+#include "bandit.h"
+#include "trace.h"
 
 extern int coverage_enable;
 extern int coverage_bool;
@@ -29,6 +26,11 @@ typedef struct {
     char const * a[3] = {NULL, NULL, NULL};
 } triple;
 
+// timeout of the solver queries, until their latencies are known
+static const unsigned MAX_TIMEOUT_MS = 5000;
+// largest group of bits flipped by one query in batched mode
+static const int MAX_FLIP_BATCH = 64;
+
 class SMTSampler {
     std::string input_file;
 
@@ -45,6 +47,11 @@ class SMTSampler {
     bool convert = false;
     bool const flip_internal = false;
     bool random_soft_bit = false;
+    bool batch_flips = false;
+    double flip_batch = 1.0; // current group size of batched flips, adapted to their sat ratio across epochs
+    int batch_queries = 0;
+    int batch_sat = 0;
+    FlipBandit flip_bandit; // orders the flips by their yield in the previous epochs
     z3::apply_result * res0;
     z3::goal * converted_goal;
     z3::params params;
@@ -70,6 +77,11 @@ class SMTSampler {
     int all_ind_count = 0;
 
     std::ofstream results_file;
+    Random rng;
+    // latencies of the epoch and flip MaxSMT queries and of the plain SMT fallback, for their adaptive timeouts
+    LatencyHistogram epoch_latency;
+    LatencyHistogram flip_latency;
+    LatencyHistogram smt_latency;
 
     //bat
     //std::unordered_set<Z3_ast> ;
@@ -79,14 +91,31 @@ public:
     SMTSampler(std::string input, int max_samples, double max_time, int strategy) : opt(c), params(c), solver(c), model(c), smt_formula(c), input_file(input), max_samples(max_samples), max_time(max_time), strategy(strategy) {
         z3::set_param("rewriter.expand_select_store", "true");
 //        std::cout<<"this is meeeeeeeeeeeeeee"<<std::endl;
-        params.set("timeout", 5000u);
+        params.set("timeout", MAX_TIMEOUT_MS);
         opt.set(params);
         solver.set(params);
         convert = strategy == STRAT_SAT;
+        rng.set_seed((uint64_t)time(NULL) ^ monotonic_ns());
+        clock_gettime(CLOCK_REALTIME, &start_time);
+    }
+
+    void set_seed(uint64_t seed) {
+        rng.set_seed(seed);
+    }
+
+    void set_maxsmt_engine(const std::string & engine) {
+        params.set("maxsat_engine", c.str_symbol(engine.c_str()));
+        opt.set(params);
+    }
+
+    /*
+     * Flips bits in groups, with one query per group (see flip_batched) instead of one per bit.
+     */
+    void set_batch_flips(bool batch) {
+        batch_flips = batch;
     }
 
     void run() {
-        srand(start_time.tv_sec);
         // parse_cnf();
         //parse_smt(); // bat: parse-formula (visit) + solve initially
 //        MEGASampler ms(smt_formula);
@@ -103,24 +132,25 @@ public:
                 {
 		    if (random_soft_bit) {
                         for (int i = 0; i < v.range().bv_size(); ++i) {
-                            if (rand() % 2)
+                            if (rng.next_bool())
                                 assert_soft(v().extract(i, i) == c.bv_val(0, 1));
                             else
                                 assert_soft(v().extract(i, i) != c.bv_val(0, 1));
                         }
 		    } else {
-                        std::string n;
-                        char num[10];
-                        int i = v.range().bv_size();
-                        if (i % 4) {
-                            snprintf(num, 10, "%x", rand() & ((1<<(i%4)) - 1));
-                            n += num;
-                            i -= (i % 4);
-                        }
-                        while (i) {
-                            snprintf(num, 10, "%x", rand() & 15);
-                            n += num;
-                            i -= 4;
+                        // 16 hex digits from each 64-bit draw
+                        int size = v.range().bv_size();
+                        int digits = (size + 3) / 4;
+                        std::string n(digits, '0');
+                        uint64_t word = 0;
+                        for (int d = 0; d < digits; ++d) {
+                            if (d % 16 == 0)
+                                word = rng.next();
+                            int digit = word & 15;
+                            if (d == 0 && size % 4)
+                                digit &= (1 << (size % 4)) - 1;
+                            n[d] = "0123456789abcdef"[digit];
+                            word >>= 4;
                         }
                         Z3_ast ast = parse_bv(n.c_str(), v.range(), c);
                         z3::expr exp(c, ast);
@@ -129,7 +159,7 @@ public:
                     break; // from switch, bv case
                 }
                 case Z3_BOOL_SORT: // random assignment to bool var
-                    if (rand() % 2)
+                    if (rng.next_bool())
                         assert_soft(v());
                     else
                         assert_soft(!v());
@@ -140,7 +170,7 @@ public:
                 }
 
             } //end for: random assignment chosen
-            z3::check_result result = solve(); //bat: find closest solution to random assignment (or some solution)
+            z3::check_result result = solve(epoch_latency); //bat: find closest solution to random assignment (or some solution)
             if (result == z3::unsat) {
                 std::cout << "No solutions\n";
                 break;
@@ -202,7 +232,10 @@ public:
         std::cout << "Check time " << check_time << '\n';
         std::cout << "Coverage time: " << cov_time << '\n';
         std::cout << "Coverage bool: " << coverage_bool - coverage_all_bool << '/' << coverage_all_bool << ", coverage bv " << coverage_bv - coverage_all_bv << '/' << coverage_all_bv << '\n';
-        std::cout << "Epochs " << epochs << ", Flips " << flips << ", UnsatInd " << unsat_ind_count << '/' << all_ind_count << ", UnsatInternal " << unsat_internal.size() << ", Calls " << solver_calls << '\n' << std::flush;
+        std::cout << "Epochs " << epochs << ", Flips " << flips << ", UnsatInd " << unsat_ind_count << '/' << all_ind_count << ", UnsatInternal " << unsat_internal.size() << ", Calls " << solver_calls << '\n';
+        if (batch_flips)
+            std::cout << "Batched flips: " << batch_sat << '/' << batch_queries << " sat, group size " << (int)flip_batch << '\n';
+        std::cout << std::flush;
     }
 
     std::unordered_set<Z3_ast> sub; //bat: internal nodes
@@ -324,7 +357,7 @@ public:
         } else {
             opt.add(formula); //adds formula as hard constraint to optimization solver (no weight specified for it)
             solver.add(formula); //adds formula as constraint to normal solver
-            z3::check_result result = solve(); // will try to solve the formula and put model in model variable
+            z3::check_result result = solve(epoch_latency); // will try to solve the formula and put model in model variable
             if (result == z3::unsat) {
                 std::cout << "Formula is unsat\n";
                 exit(0);
@@ -356,6 +389,54 @@ public:
         return start_time;
     }
 
+    /*
+     * parses input_file into smt_formula and collects its variables (without solving it)
+     */
+    void parse_formula() {
+        smt_formula = c.parse_file(input_file.c_str());
+        compute_formula_statistics();
+    }
+
+    z3::context & get_context() {
+        return c;
+    }
+
+    z3::expr get_formula() {
+        return smt_formula;
+    }
+
+    std::vector<z3::func_decl> const & get_variables() {
+        return variables;
+    }
+
+    std::vector<z3::func_decl> const & get_ind() {
+        return ind;
+    }
+
+    /*
+     * adds smt_formula as a hard constraint, without solving it (see parse_formula)
+     */
+    void assert_formula() {
+        opt.add(smt_formula);
+        solver.add(smt_formula);
+    }
+
+    int get_solver_calls() {
+        return solver_calls;
+    }
+
+    int get_flips() {
+        return flips;
+    }
+
+    int get_unsat_ind_count() {
+        return unsat_ind_count;
+    }
+
+    int get_flip_arms() {
+        return flip_bandit.size();
+    }
+
     void print_formula_statistics(){
     	std::cout << "Nodes " << sup.size() << '\n';
 		std::cout << "Internal nodes " << sub.size() << '\n';
@@ -465,6 +546,52 @@ public:
         std::unordered_set<std::string> mutations;
         std::string m_string = model_string(m, ind);
         output(m, 0);
+        flip_bits(m, m_string, mutations);
+
+        std::vector<std::string> initial(mutations.begin(), mutations.end());
+        std::vector<std::string> sigma = initial;
+
+        for (int k = 2; k <= 6; ++k) {
+                TraceScope trace("combination_round", "output");
+                std::cout << "Combining " << k << " mutations\n";
+                std::vector<std::string> new_sigma;
+                int all = 0;
+                int good = 0;
+
+                for (std::string b_string : sigma) {
+                    for (std::string c_string : initial) {
+                        std::string candidate = combine_models(m_string, b_string, c_string);
+                        if (mutations.find(candidate) == mutations.end()) {
+                            mutations.insert(candidate);
+                            bool valid;
+                            if (convert) {
+                                z3::model cand = gen_model(candidate, ind);
+                                valid = output(cand, k);
+                            } else {
+                                valid = output(candidate, k);
+                            }
+                            ++all;
+                            if (valid) {
+                                ++good;
+                                new_sigma.push_back(candidate);
+                            }
+                        }
+                    }
+                }
+                double accuracy = (double)good / (double)all;
+                std::cout << "Valid: " << good << " / " << all << " = " << accuracy << '\n';
+                print_stats();
+                if (all == 0 || accuracy < 0.1)
+                    break;
+                sigma = new_sigma;
+        }
+    }
+
+    /*
+     * Flip phase of sample(): looks for a model differing from m (serialized as m_string) in each of its bits
+     * (or in groups of bits, see set_batch_flips) and adds the new models to mutations.
+     */
+    void flip_bits(z3::model m, std::string const & m_string, std::unordered_set<std::string> & mutations) {
         opt.push();
         solver.push();
         size_t pos = 0;
@@ -540,13 +667,13 @@ public:
         double start_epoch = duration(&start_time, &etime);
 
         print_stats();
+        std::vector<int> order = flip_order();
+        if (batch_flips)
+            flip_batched(order, mutations, start_epoch);
         int calls = 0;
         int progress = 0;
-        for (int count = 0; count < constraints.size(); ++count) {
-            auto u = unsat_ind.find(cons_to_ind[count].first);
-            if (u != unsat_ind.end() && u->second.find(cons_to_ind[count].second) != u->second.end()) {
-                continue;
-            }
+        for (int i = 0; i < order.size() && !batch_flips; ++i) {
+            int count = order[i];
             z3::expr & cond = constraints[count];
             opt.push();
             solver.push();
@@ -560,37 +687,42 @@ public:
             double elapsed = duration(&start_time, &end);
 
             double cost = calls ? (elapsed - start_epoch) / calls : 0.0;
-            cost *= constraints.size() - count;
+            cost *= order.size() - i;
             if (max_time/3.0 + start_epoch > max_time && elapsed + cost > max_time) {
                 std::cout << "Stopping: slow\n";
                 finish();
             }
+            // flips skipped at random when time runs short teach the bandit nothing, so they are not recorded
             z3::check_result result = z3::unknown;
-            if (cost * rand() <= (max_time/3.0 + start_epoch - elapsed) * RAND_MAX) {
-                result = solve();
+            bool queried = false;
+            uint64_t query_start = monotonic_ns();
+            if (cost * rng.next_double() <= max_time/3.0 + start_epoch - elapsed) {
+                TraceScope trace("flip_query", "solver");
+                result = solve(flip_latency);
                 ++calls;
+                queried = true;
             }
+            double seconds = (monotonic_ns() - query_start) / 1.0e9;
+            double found = 0.0;
             if (result == z3::sat) {
                 std::string new_string = model_string(model, ind);
                 if (mutations.find(new_string) == mutations.end()) {
                     mutations.insert(new_string);
                     output(model, 1);
                     flips += 1;
+                    found = 1.0;
                 } else {
                     // std::cout << "repeated\n";
                 }
             } else if (result == z3::unsat) {
                 // std::cout << "unsat\n";
-                if (!is_ind(count)) {
-                    unsat_internal.insert(count);
-                } else if (cons_to_ind[count].first >= 0) {
-                    unsat_ind[cons_to_ind[count].first].insert(cons_to_ind[count].second);
-                    ++unsat_ind_count;
-                }
+                mark_unsat(count);
             }
+            if (queried)
+                record_flip(count, found, seconds);
             opt.pop();
             solver.pop();
-            double new_progress = 80.0 * (double)(count + 1) / (double)constraints.size();
+            double new_progress = 80.0 * (double)(i + 1) / (double)order.size();
             while (progress < new_progress) {
                 ++progress;
                 std::cout << '=' << std::flush;
@@ -598,68 +730,107 @@ public:
         }
         std::cout << '\n';
 
-        std::vector<std::string> initial(mutations.begin(), mutations.end());
-        std::vector<std::string> sigma = initial;
+        opt.pop();
+        solver.pop();
+    }
 
-        for (int k = 2; k <= 6; ++k) {
-                std::cout << "Combining " << k << " mutations\n";
-                std::vector<std::string> new_sigma;
-                int all = 0;
-                int good = 0;
+    /*
+     * Flip loop of sample() in batched mode. Each query takes the next flip_batch untried constraints and asks
+     * for a model violating at least one of them. A sat answer settles every untried constraint its model
+     * violates, the others of the group are tried again; an unsat answer fixes all the constraints of the group.
+     * The group size doubles after an unsat answer and halves after a sat one, so that about half of the
+     * queries are sat: large groups where most bits are fixed, single bits where most can be flipped.
+     * Constraints are taken in the given order (see flip_order).
+     */
+    void flip_batched(std::vector<int> const & order, std::unordered_set<std::string> & mutations, double start_epoch) {
+        std::deque<int> pending(order.begin(), order.end());
+        int total = pending.size();
+        int calls = 0;
+        int progress = 0;
+        while (!pending.empty()) {
+            int k = std::min((int)pending.size(), (int)flip_batch);
+            std::vector<int> group(pending.begin(), pending.begin() + k);
+            pending.erase(pending.begin(), pending.begin() + k);
+            z3::expr_vector differ(c);
+            for (int count : group)
+                differ.push_back(!constraints[count]);
+            z3::expr any = z3::mk_or(differ);
+            opt.push();
+            solver.push();
+            opt.add(any);
+            solver.add(any);
+            for (int count : group) {
+                for (z3::expr & soft : soft_constraints[count]) {
+                    assert_soft(soft);
+                }
+            }
+            struct timespec end;
+            clock_gettime(CLOCK_REALTIME, &end);
+            double elapsed = duration(&start_time, &end);
 
-                for (std::string b_string : sigma) {
-                    for (std::string c_string : initial) {
-                        size_t pos_a = 0;
-                        size_t pos_b = 0;
-                        size_t pos_c = 0;
-                        std::string candidate;
-                        for (z3::func_decl & w : ind) {
-                            if (w.range().is_array()) {
-                                int arity = 0;
-                                z3::sort s = w.range().array_range();
-                                combine_function(m_string, b_string, c_string,
-                                                 pos_a, pos_b, pos_c, arity, s, candidate);
-                            } else if (w.is_const()) {
-                                z3::sort s = w.range();
-                                std::string num = combine(m_string.c_str() + pos_a, b_string.c_str() + pos_b, c_string.c_str() + pos_c, s);
-                                pos_a = m_string.find('\0', pos_a) + 1;
-                                pos_b = b_string.find('\0', pos_b) + 1;
-                                pos_c = c_string.find('\0', pos_c) + 1;
-                                candidate += num + '\0';
-                            } else {
-                                int arity = w.arity();
-                                z3::sort s = w.range();
-                                combine_function(m_string, b_string, c_string,
-                                                 pos_a, pos_b, pos_c, arity, s, candidate);
-                            }
-                        }
-                        if (mutations.find(candidate) == mutations.end()) {
-                            mutations.insert(candidate);
-                            bool valid;
-                            if (convert) {
-                                z3::model cand = gen_model(candidate, ind);
-                                valid = output(cand, k);
-                            } else {
-                                valid = output(candidate, k);
-                            }
-                            ++all;
-                            if (valid) {
-                                ++good;
-                                new_sigma.push_back(candidate);
-                            }
-                        }
-                    }
+            double cost = calls ? (elapsed - start_epoch) / calls : 0.0;
+            cost *= (pending.size() + k) / flip_batch;
+            if (max_time/3.0 + start_epoch > max_time && elapsed + cost > max_time) {
+                std::cout << "Stopping: slow\n";
+                finish();
+            }
+            z3::check_result result = z3::unknown;
+            bool queried = false;
+            uint64_t query_start = monotonic_ns();
+            if (cost * rng.next_double() <= max_time/3.0 + start_epoch - elapsed) {
+                TraceScope trace("flip_query", "solver");
+                result = solve(flip_latency);
+                ++calls;
+                ++batch_queries;
+                queried = true;
+            }
+            double seconds = (monotonic_ns() - query_start) / 1.0e9;
+            if (result == z3::sat) {
+                ++batch_sat;
+                flip_batch = std::max(1.0, flip_batch / 2);
+                std::string new_string = model_string(model, ind);
+                double found = 0.0;
+                if (mutations.find(new_string) == mutations.end()) {
+                    mutations.insert(new_string);
+                    output(model, 1);
+                    flips += 1;
+                    found = 1.0;
                 }
-                double accuracy = (double)good / (double)all;
-                std::cout << "Valid: " << good << " / " << all << " = " << accuracy << '\n';
-                print_stats();
-                if (all == 0 || accuracy < 0.1)
-                    break;
-                sigma = new_sigma;
+                // the sample is credited to the flipped bits of the group, the time to all of them
+                std::deque<int> unsettled;
+                std::vector<int> flipped;
+                for (int count : group) {
+                    if (!model.eval(constraints[count], true).is_false())
+                        unsettled.push_back(count);
+                    else
+                        flipped.push_back(count);
+                }
+                for (int count : group) {
+                    bool hit = std::find(flipped.begin(), flipped.end(), count) != flipped.end();
+                    record_flip(count, hit ? found / flipped.size() : 0.0, seconds / k);
+                }
+                for (int count : pending) {
+                    if (!model.eval(constraints[count], true).is_false())
+                        unsettled.push_back(count);
+                }
+                pending.swap(unsettled);
+            } else if (result == z3::unsat) {
+                flip_batch = std::min((double)MAX_FLIP_BATCH, flip_batch * 2);
+                for (int count : group)
+                    mark_unsat(count);
+            }
+            if (queried && result != z3::sat) {
+                for (int count : group)
+                    record_flip(count, 0.0, seconds / k);
+            }
+            opt.pop();
+            solver.pop();
+            double new_progress = 80.0 * (double)(total - pending.size()) / (double)total;
+            while (progress < new_progress) {
+                ++progress;
+                std::cout << '=' << std::flush;
+            }
         }
-
-        opt.pop();
-        solver.pop();
     }
 
     void add_constraints(z3::expr exp, z3::expr val, int count) {
@@ -738,6 +909,37 @@ public:
         exit(1);
     }
 
+    /*
+     * combines three model strings (see model_string) value by value into a new candidate
+     */
+    std::string combine_models(std::string const & m_string, std::string const & b_string, std::string const & c_string) {
+        size_t pos_a = 0;
+        size_t pos_b = 0;
+        size_t pos_c = 0;
+        std::string candidate;
+        for (z3::func_decl & w : ind) {
+            if (w.range().is_array()) {
+                int arity = 0;
+                z3::sort s = w.range().array_range();
+                combine_function(m_string, b_string, c_string,
+                                 pos_a, pos_b, pos_c, arity, s, candidate);
+            } else if (w.is_const()) {
+                z3::sort s = w.range();
+                std::string num = combine(m_string.c_str() + pos_a, b_string.c_str() + pos_b, c_string.c_str() + pos_c, s);
+                pos_a = m_string.find('\0', pos_a) + 1;
+                pos_b = b_string.find('\0', pos_b) + 1;
+                pos_c = c_string.find('\0', pos_c) + 1;
+                candidate += num + '\0';
+            } else {
+                int arity = w.arity();
+                z3::sort s = w.range();
+                combine_function(m_string, b_string, c_string,
+                                 pos_a, pos_b, pos_c, arity, s, candidate);
+            }
+        }
+        return candidate;
+    }
+
     std::string combine(char const * val_a, char const * val_b, char const * val_c, z3::sort s) {
         std::string num;
         while (*val_a) {
@@ -791,6 +993,50 @@ public:
         return !flip_internal || count >= internal.size();
     }
 
+    /*
+     * true if constraints[count] is a bit of an independent variable already known to be fixed
+     */
+    bool is_known_unsat(int count) {
+        auto u = unsat_ind.find(cons_to_ind[count].first);
+        return u != unsat_ind.end() && u->second.find(cons_to_ind[count].second) != u->second.end();
+    }
+
+    /*
+     * records that constraints[count] holds in every solution
+     */
+    void mark_unsat(int count) {
+        if (!is_ind(count)) {
+            unsat_internal.insert(count);
+        } else if (cons_to_ind[count].first >= 0) {
+            unsat_ind[cons_to_ind[count].first].insert(cons_to_ind[count].second);
+            ++unsat_ind_count;
+        }
+    }
+
+    /*
+     * The constraints to flip in this epoch, by decreasing score of the flip_bandit, without the ones known
+     * to be fixed. Each constraint is its own arm, keyed by the term it fixes (constraints[count].arg(0)):
+     * a bit of an independent variable, of an array entry or of a function application.
+     */
+    std::vector<int> flip_order() {
+        std::vector<int> candidates;
+        std::vector<z3::expr> terms;
+        for (int count = 0; count < constraints.size(); ++count) {
+            if (is_known_unsat(count))
+                continue;
+            candidates.push_back(count);
+            terms.push_back(constraints[count].arg(0));
+        }
+        std::vector<int> order;
+        for (int i : flip_bandit.order(terms))
+            order.push_back(candidates[i]);
+        return order;
+    }
+
+    void record_flip(int count, double samples, double seconds) {
+        flip_bandit.record(constraints[count].arg(0), samples, seconds);
+    }
+
     z3::model gen_model(std::string candidate, std::vector<z3::func_decl> ind) {
         z3::model m(c);
         size_t pos = 0;
@@ -929,11 +1175,17 @@ public:
 
     void finish() {
         print_stats();
+        trace_finish();
         results_file.close();
         exit(0);
     }
 
-    z3::check_result solve() {
+    /*
+     * Solves the MaxSMT instance, falling back to the plain SMT instance if it times out.
+     * latencies holds the latencies of previous queries of the same class, which set the MaxSMT timeout
+     * (see adaptive_timeout_ms), so that a single pathological query does not stall an epoch.
+     */
+    z3::check_result solve(LatencyHistogram & latencies) {
         struct timespec start;
         clock_gettime(CLOCK_REALTIME, &start);
         double elapsed = duration(&start_time, &start);
@@ -946,22 +1198,30 @@ public:
             finish();
         }
         z3::check_result result = z3::unknown;
+        params.set("timeout", adaptive_timeout_ms(latencies, MAX_TIMEOUT_MS));
+        opt.set(params);
+        uint64_t check_start = monotonic_ns();
         try {
             result = opt.check(); //bat: first, solve a MAX-SMT instance
         } catch (z3::exception except) {
             std::cout << "Exception: " << except << "\n";
             exit(1);
         }
+        latencies.record(monotonic_ns() - check_start);
         if (result == z3::sat) {
             model = opt.get_model();
         } else if (result == z3::unknown) {
             std::cout << "MAX-SMT timed out"<< "\n";
+            params.set("timeout", adaptive_timeout_ms(smt_latency, MAX_TIMEOUT_MS));
+            solver.set(params);
+            check_start = monotonic_ns();
             try {
                 result = solver.check(); //bat: if too long, solve a regular SMT instance (without any soft constraints)
             } catch (z3::exception except) {
                 std::cout << "Exception: " << except << "\n";
                 exit(1);
             }
+            smt_latency.record(monotonic_ns() - check_start);
             std::cout << "SMT result: " << result << "\n";
             if (result == z3::sat) {
                 model = solver.get_model();
@@ -0,0 +1,116 @@
+/*
+ * solver_stats.cpp
+ *
+ *  Aggregation of Z3 solver statistics per epoch and per strategy.
+ */
+#include "solver_stats.h"
+#include <algorithm>
+
+bool SolverStatistics::is_gauge(const std::string & key){
+	return key.find("memory") != std::string::npos;
+}
+
+bool SolverStatistics::is_global(const std::string & key){
+	// rlimit and allocation counters are kept by the context, so they grow across checks of any solver
+	return key == "rlimit count" || key == "num allocs";
+}
+
+SolverStatistics::Counters SolverStatistics::counters_of(const z3::stats & st, Counters & last){
+	Counters counters;
+	for (unsigned i = 0; i < st.size(); i++){
+		std::string key = st.key(i);
+		std::replace(key.begin(), key.end(), '-', ' '); // Z3 mixes "max-memory" and "max memory" styles
+		double value = st.is_uint(i) ? st.uint_value(i) : st.double_value(i);
+		if (is_global(key)){
+			double & l = last[key];
+			double delta = value >= l ? value - l : value;
+			l = value;
+			value = delta;
+		}
+		counters[key] = value;
+	}
+	return counters;
+}
+
+void SolverStatistics::add(const std::string & source, const z3::stats & st, bool cumulative){
+	Counters counters = counters_of(st, previous["context"]);
+	if (cumulative){
+		Counters & prev = previous[source];
+		for (auto & kv : counters){
+			if (is_gauge(kv.first) || is_global(kv.first)){
+				continue;
+			}
+			double & last = prev[kv.first];
+			double delta = kv.second >= last ? kv.second - last : kv.second;
+			last = kv.second;
+			kv.second = delta;
+		}
+	}
+	add_counters(source, counters);
+}
+
+void SolverStatistics::add_counters(const std::string & source, const Counters & counters){
+	epoch[source + " calls"] += 1;
+	for (const auto & kv : counters){
+		std::string name = source + " " + kv.first;
+		if (is_gauge(kv.first)){
+			epoch[name] = std::max(epoch[name], kv.second);
+			continue;
+		}
+		if (kv.first == "rlimit count"){
+			rlimit += kv.second;
+		}
+		epoch[name] += kv.second;
+	}
+}
+
+void SolverStatistics::print_summary(const Counters & counters, std::ostream & out){
+	double calls = 0, conflicts = 0, decisions = 0, propagations = 0, memory = 0, cores = 0;
+	for (const auto & kv : counters){
+		const std::string & key = kv.first;
+		if (key.find(" calls") != std::string::npos){
+			calls += kv.second;
+		} else if (key.find("conflicts") != std::string::npos){
+			conflicts += kv.second;
+		} else if (key.find("decisions") != std::string::npos){
+			decisions += kv.second;
+		} else if (key.find("propagations") != std::string::npos){
+			propagations += kv.second;
+		} else if (key.find("max memory") != std::string::npos){
+			memory = std::max(memory, kv.second);
+		} else if (key.find("maxres cores") != std::string::npos){
+			cores += kv.second;
+		}
+	}
+	out << "calls " << calls << ", conflicts " << conflicts << ", decisions " << decisions << ", propagations " << propagations
+			<< ", max memory " << memory << " MB, MaxSMT cores " << cores;
+}
+
+void SolverStatistics::end_epoch(const std::string & strategy, std::ostream & out){
+	if (epoch.empty()){
+		return;
+	}
+	out << "Epoch solver statistics: ";
+	print_summary(epoch, out);
+	out << '\n';
+	Counters & total = per_strategy[strategy];
+	for (const auto & kv : epoch){
+		if (is_gauge(kv.first)){
+			total[kv.first] = std::max(total[kv.first], kv.second);
+		} else {
+			total[kv.first] += kv.second;
+		}
+	}
+	epoch.clear();
+}
+
+void SolverStatistics::print(std::ostream & out) const{
+	for (const auto & s : per_strategy){
+		out << "Solver statistics (" << s.first << "): ";
+		print_summary(s.second, out);
+		out << '\n';
+		for (const auto & kv : s.second){
+			out << "  " << kv.first << ": " << kv.second << '\n';
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * solver_stats.h
+ *
+ *  Aggregation of Z3 solver statistics per epoch and per strategy.
+ */
+
+#ifndef SOLVER_STATS_H_
+#define SOLVER_STATS_H_
+
+#include <z3++.h>
+#include <map>
+#include <string>
+#include <ostream>
+
+class SolverStatistics{
+
+public:
+	typedef std::map<std::string, double> Counters;
+
+private:
+	std::map<std::string, Counters> previous; // last snapshot of each cumulative source
+	Counters epoch; // statistics of the current epoch
+	std::map<std::string, Counters> per_strategy;
+	double rlimit = 0; // resources used by all checks
+
+public:
+	/*
+	 * Adds the statistics of a check to the current epoch, with keys prefixed by source.
+	 * If cumulative, st holds totals since the solver was created and only the difference
+	 * from the previous snapshot of source is added.
+	 * Memory statistics are gauges and keep their maximum instead of being summed.
+	 */
+	void add(const std::string & source, const z3::stats & st, bool cumulative);
+	/*
+	 * Adds the counters of a check (see counters_of) to the current epoch, with keys prefixed by source.
+	 */
+	void add_counters(const std::string & source, const Counters & counters);
+	/*
+	 * Returns the statistics of a check as counters. The counters kept by the context (rlimit, allocations)
+	 * are replaced by their growth since the values in last, which are updated.
+	 * Used directly for checks made in another context, whose counters are then passed to add_counters.
+	 */
+	static Counters counters_of(const z3::stats & st, Counters & last);
+	/*
+	 * Prints a summary of the current epoch (conflicts, decisions, propagations, memory, MaxSMT cores),
+	 * adds it to the totals of the given strategy and starts a new epoch.
+	 */
+	void end_epoch(const std::string & strategy, std::ostream & out);
+	/*
+	 * Prints the summary and all aggregated counters of every strategy.
+	 */
+	void print(std::ostream & out) const;
+	/*
+	 * Returns the Z3 resources (rlimit count) used by all the checks added so far.
+	 */
+	double get_rlimit() const { return rlimit; }
+
+protected:
+	static bool is_gauge(const std::string & key);
+	static bool is_global(const std::string & key);
+	static void print_summary(const Counters & counters, std::ostream & out);
+};
+
+#endif /* SOLVER_STATS_H_ */
@@ -0,0 +1,110 @@
+/*
+ * timers.cpp
+ *
+ *  Scoped timers with per-category latency histograms.
+ */
+#include "timers.h"
+#include "trace.h"
+#include <algorithm>
+
+const char * timer_name(TimerCategory category){
+	switch (category){
+		case TIMER_INITIAL_SOLVING: return "initial_solving";
+		case TIMER_CONVERSION: return "conversion";
+		case TIMER_INDEPENDENT_SUPPORT: return "independent_support";
+		case TIMER_START_EPOCH: return "start_epoch";
+		case TIMER_DO_EPOCH: return "do_epoch";
+		case TIMER_MAXSMT: return "maxsmt";
+		case TIMER_SMT: return "smt";
+		case TIMER_GF2: return "gf2";
+		case TIMER_FLIP: return "flip";
+		case TIMER_VALIDATION: return "validation";
+		case TIMER_COVERAGE: return "coverage";
+		default: return "unknown";
+	}
+}
+
+LatencyHistogram::LatencyHistogram() : count(0), total_ns(0){
+	for (int i = 0; i < NUM_BUCKETS; i++){
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+int LatencyHistogram::bucket_of(uint64_t ns){
+	if (ns < SUB_BUCKETS){
+		return ns;
+	}
+	int exponent = 63 - __builtin_clzll(ns); // position of the leading bit
+	int sub = (ns >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1); // bits following the leading bit
+	return (exponent - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(int bucket){
+	if (bucket < SUB_BUCKETS){
+		return bucket;
+	}
+	int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+	uint64_t sub = bucket % SUB_BUCKETS;
+	return ((SUB_BUCKETS + sub + 1) << (exponent - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns){
+	buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	total_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::quantile(double p) const{
+	uint64_t n = get_count();
+	if (n == 0){
+		return 0.0;
+	}
+	uint64_t rank = (uint64_t)(p * n);
+	if (rank == 0){
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++){
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank){
+			return bucket_upper_bound(i) * 1.0e-9;
+		}
+	}
+	return bucket_upper_bound(NUM_BUCKETS - 1) * 1.0e-9;
+}
+
+// adaptive timeouts: factor * p95 of at least MIN_CALLS latencies, never below MIN_TIMEOUT_MS
+static const uint64_t TIMEOUT_MIN_CALLS = 10;
+static const double TIMEOUT_QUANTILE = 0.95;
+static const double TIMEOUT_FACTOR = 4.0;
+static const unsigned MIN_TIMEOUT_MS = 100;
+
+unsigned adaptive_timeout_ms(const LatencyHistogram & latencies, unsigned max_ms){
+	if (latencies.get_count() < TIMEOUT_MIN_CALLS){
+		return max_ms;
+	}
+	double ms = TIMEOUT_FACTOR * latencies.quantile(TIMEOUT_QUANTILE) * 1000.0;
+	if (ms >= max_ms){
+		return max_ms;
+	}
+	return ms < MIN_TIMEOUT_MS ? std::min(MIN_TIMEOUT_MS, max_ms) : (unsigned)ms;
+}
+
+void Timers::print(std::ostream & out) const{
+	for (int i = 0; i < NUM_TIMERS; i++){
+		const LatencyHistogram & h = histograms[i];
+		if (h.get_count() == 0){
+			continue;
+		}
+		out << timer_name((TimerCategory)i) << " time: " << h.get_total() << " (calls: " << h.get_count()
+				<< ", p50: " << h.quantile(0.5) << ", p95: " << h.quantile(0.95) << ", p99: " << h.quantile(0.99) << ")\n";
+	}
+}
+
+ScopedTimer::~ScopedTimer(){
+	uint64_t end_ns = monotonic_ns();
+	timers.record(category, end_ns - start_ns);
+	if (trace_enabled){
+		trace_event(timer_name(category), "phase", start_ns, end_ns);
+	}
+}
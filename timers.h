@@ -0,0 +1,112 @@
+/*
+ * timers.h
+ *
+ *  Scoped timers with per-category latency histograms.
+ */
+
+#ifndef TIMERS_H_
+#define TIMERS_H_
+
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+#include <time.h>
+
+enum TimerCategory {
+	TIMER_INITIAL_SOLVING,
+	TIMER_CONVERSION,
+	TIMER_INDEPENDENT_SUPPORT,
+	TIMER_START_EPOCH,
+	TIMER_DO_EPOCH,
+	TIMER_MAXSMT,
+	TIMER_SMT,
+	TIMER_GF2,
+	TIMER_FLIP,
+	TIMER_VALIDATION,
+	TIMER_COVERAGE,
+	NUM_TIMERS
+};
+
+/*
+ * Returns the name of a timer category, as printed in the statistics.
+ */
+const char * timer_name(TimerCategory category);
+
+/*
+ * Returns the current time of the monotonic clock in nanoseconds.
+ */
+inline uint64_t monotonic_ns(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/*
+ * Lock-free histogram of latencies.
+ * Buckets are logarithmic: each power of two is split into SUB_BUCKETS linear buckets,
+ * so percentiles are accurate to within 1/SUB_BUCKETS of their value.
+ */
+class LatencyHistogram{
+
+	static const int SUB_BITS = 2;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	static const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+	std::atomic<uint64_t> buckets[NUM_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> total_ns;
+
+public:
+	LatencyHistogram();
+	void record(uint64_t ns);
+	uint64_t get_count() const { return count.load(std::memory_order_relaxed); }
+	double get_total() const { return total_ns.load(std::memory_order_relaxed) * 1.0e-9; }
+	/*
+	 * Returns (an upper bound of) the p-th quantile in seconds, for 0 < p <= 1.
+	 */
+	double quantile(double p) const;
+
+protected:
+	static int bucket_of(uint64_t ns);
+	static uint64_t bucket_upper_bound(int bucket);
+};
+
+/*
+ * Returns a timeout in milliseconds for the next query of a class whose latencies are recorded in latencies:
+ * a multiple of their 95th percentile, at most max_ms, and max_ms until a few latencies were recorded.
+ * Queries that time out are recorded with the timeout as their latency, so if too many of them time out
+ * the percentile reaches the timeout and the next timeout grows.
+ */
+unsigned adaptive_timeout_ms(const LatencyHistogram & latencies, unsigned max_ms);
+
+class Timers{
+
+	LatencyHistogram histograms[NUM_TIMERS];
+
+public:
+	void record(TimerCategory category, uint64_t ns) { histograms[category].record(ns); }
+	const LatencyHistogram & get(TimerCategory category) const { return histograms[category]; }
+	/*
+	 * Prints total time, number of measurements and p50/p95/p99 of every category that was measured.
+	 */
+	void print(std::ostream & out) const;
+};
+
+/*
+ * Measures the time from its construction to its destruction under the given category,
+ * and records it as a trace event when tracing is enabled (see trace.h).
+ */
+class ScopedTimer{
+
+	Timers & timers;
+	TimerCategory category;
+	uint64_t start_ns;
+
+public:
+	ScopedTimer(Timers & timers, TimerCategory category) : timers(timers), category(category), start_ns(monotonic_ns()) {}
+	~ScopedTimer();
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer & operator=(const ScopedTimer &) = delete;
+};
+
+#endif /* TIMERS_H_ */
@@ -0,0 +1,73 @@
+/*
+ * trace.cpp
+ *
+ *  Timeline of sampling phases in Chrome trace-event format.
+ */
+#include "trace.h"
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> trace_enabled(false);
+
+struct TraceEvent{
+	const char * name;
+	const char * category;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+struct TraceBuffer{
+	int tid;
+	std::vector<TraceEvent> events;
+};
+
+static std::string trace_path;
+static uint64_t trace_origin_ns = 0;
+static std::mutex registry_mutex;
+static std::vector<TraceBuffer *> buffers; // never freed, threads may exit before the trace is written
+static thread_local TraceBuffer * local_buffer = NULL;
+
+void trace_start(const std::string & path){
+	trace_path = path;
+	trace_origin_ns = monotonic_ns();
+	trace_enabled = true;
+}
+
+void trace_event(const char * name, const char * category, uint64_t start_ns, uint64_t end_ns){
+	if (!local_buffer){
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		local_buffer = new TraceBuffer();
+		local_buffer->tid = buffers.size() + 1;
+		buffers.push_back(local_buffer);
+	}
+	local_buffer->events.push_back({name, category, start_ns, end_ns});
+}
+
+void trace_finish(){
+	if (!trace_enabled.exchange(false)){
+		return;
+	}
+	std::ofstream out(trace_path);
+	if (!out){
+		std::cout << "Could not write trace file " << trace_path << '\n';
+		return;
+	}
+	out.setf(std::ios::fixed);
+	out.precision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (TraceBuffer * buffer : buffers){
+		for (const TraceEvent & e : buffer->events){
+			out << (first ? "" : ",\n");
+			first = false;
+			// timestamps are in microseconds
+			out << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+					<< ",\"ts\":" << (e.start_ns - trace_origin_ns) * 1.0e-3 << ",\"dur\":" << (e.end_ns - e.start_ns) * 1.0e-3 << "}";
+		}
+	}
+	out << "\n]}\n";
+	std::cout << "Trace written to " << trace_path << '\n';
+}
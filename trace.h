@@ -0,0 +1,49 @@
+/*
+ * trace.h
+ *
+ *  Timeline of sampling phases in Chrome trace-event format.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include "timers.h"
+
+extern std::atomic<bool> trace_enabled;
+
+/*
+ * Starts recording events, to be written to path (as JSON) by trace_finish.
+ */
+void trace_start(const std::string & path);
+/*
+ * Records a complete event on the calling thread's buffer.
+ * Every thread appends only to its own buffer, so recording takes no lock
+ * (only the first event of a thread registers its buffer).
+ */
+void trace_event(const char * name, const char * category, uint64_t start_ns, uint64_t end_ns);
+/*
+ * Writes all recorded events to the trace file. Other threads must not record events meanwhile.
+ */
+void trace_finish();
+
+/*
+ * Records an event spanning from its construction to its destruction, if tracing is enabled.
+ * name and category must be string literals (they are stored by pointer).
+ */
+class TraceScope{
+
+	const char * name;
+	const char * category;
+	uint64_t start_ns;
+
+public:
+	TraceScope(const char * name, const char * category) : name(name), category(category), start_ns(trace_enabled ? monotonic_ns() : 0) {}
+	~TraceScope() { if (start_ns) trace_event(name, category, start_ns, monotonic_ns()); }
+	TraceScope(const TraceScope &) = delete;
+	TraceScope & operator=(const TraceScope &) = delete;
+};
+
+#endif /* TRACE_H_ */
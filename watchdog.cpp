@@ -0,0 +1,67 @@
+/*
+ * watchdog.cpp
+ *
+ *  Background thread enforcing the global and per-epoch deadlines by interrupting Z3.
+ */
+#include "watchdog.h"
+#include "timers.h"
+#include <chrono>
+
+// an interrupt is lost if no check is running, so it is repeated while a deadline stays expired
+static const uint64_t REPEAT_NS = 10000000;
+
+Watchdog::Watchdog(z3::context & c) : c(c), deadline_ns(0), epoch_deadline_ns(0), expired(false), epoch_expired(false), running(false){
+}
+
+Watchdog::~Watchdog(){
+	stop();
+}
+
+void Watchdog::start(uint64_t deadline){
+	deadline_ns = deadline;
+	running = true;
+	worker = std::thread(&Watchdog::run, this);
+}
+
+void Watchdog::stop(){
+	if (!running.exchange(false)){
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	wakeup.notify_all();
+	worker.join();
+}
+
+void Watchdog::set_epoch_deadline(uint64_t deadline){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		epoch_deadline_ns = deadline;
+		epoch_expired = false;
+	}
+	wakeup.notify_all();
+}
+
+void Watchdog::run(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running){
+		uint64_t now = monotonic_ns();
+		uint64_t deadline = deadline_ns;
+		uint64_t epoch = epoch_deadline_ns;
+		if (now >= deadline){
+			expired = true;
+		}
+		if (epoch && now >= epoch){
+			epoch_expired = true;
+		}
+		uint64_t wake;
+		if (expired || epoch_expired){
+			c.interrupt();
+			wake = now + REPEAT_NS;
+		} else {
+			wake = epoch && epoch < deadline ? epoch : deadline;
+		}
+		wakeup.wait_for(lock, std::chrono::nanoseconds(wake - now));
+	}
+}
@@ -0,0 +1,52 @@
+/*
+ * watchdog.h
+ *
+ *  Background thread enforcing the global and per-epoch deadlines by interrupting Z3.
+ */
+
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include <z3++.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+class Watchdog{
+
+	z3::context & c;
+	std::atomic<uint64_t> deadline_ns; // global deadline (monotonic clock)
+	std::atomic<uint64_t> epoch_deadline_ns; // 0 if no epoch is running
+	std::atomic<bool> expired;
+	std::atomic<bool> epoch_expired;
+	std::atomic<bool> running;
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+
+public:
+	Watchdog(z3::context & c);
+	~Watchdog();
+	/*
+	 * Starts watching the global deadline (in monotonic_ns time).
+	 */
+	void start(uint64_t deadline);
+	void stop();
+	/*
+	 * Sets the deadline of the current epoch (0 clears it) and resets epoch_expired.
+	 */
+	void set_epoch_deadline(uint64_t deadline);
+	/*
+	 * Cheap checks for sampling loops: true once the corresponding deadline has passed.
+	 */
+	bool is_expired() const { return expired.load(std::memory_order_relaxed); }
+	bool is_epoch_expired() const { return epoch_expired.load(std::memory_order_relaxed); }
+	uint64_t get_deadline() const { return deadline_ns.load(std::memory_order_relaxed); }
+
+protected:
+	void run();
+};
+
+#endif /* WATCHDOG_H_ */